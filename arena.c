@@ -0,0 +1,75 @@
+#include <stdbool.h> // for bool
+#include "arena.h"
+
+#define ARENA_ALIGNMENT sizeof (void *)
+
+static ArenaBlock *new_block (size_t size)
+{
+  ArenaBlock *block = malloc (sizeof (ArenaBlock) + size);
+  if (block == NULL)
+  {
+    return NULL;
+  }
+  *block = (ArenaBlock) {NULL, size, 0};
+  return block;
+}
+
+Arena *new_arena (size_t block_size)
+{
+  Arena *arena = malloc (sizeof (Arena));
+  if (arena == NULL)
+  {
+    return NULL;
+  }
+  block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+  *arena = (Arena) {NULL, block_size, 0};
+  return arena;
+}
+
+void *arena_alloc (Arena *arena, size_t size)
+{
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  ArenaBlock *block = arena->blocks;
+  if (block == NULL || block->size - block->used < size)
+  {
+    // oversized requests get a block of their own, behind the current one
+    bool own_block = size > arena->block_size / 2 && block != NULL;
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    ArenaBlock *new = new_block (own_block ? size : block_size);
+    if (new == NULL)
+    {
+      return NULL;
+    }
+    if (own_block)
+    {
+      new->next = block->next;
+      block->next = new;
+    }
+    else
+    {
+      new->next = block;
+      arena->blocks = new;
+    }
+    block = new;
+  }
+  void *memory = block->memory + block->used;
+  block->used += size;
+  arena->bytes_used += size;
+  return memory;
+}
+
+void free_arena (Arena *arena)
+{
+  if (arena == NULL)
+  {
+    return;
+  }
+  ArenaBlock *block = arena->blocks;
+  while (block != NULL)
+  {
+    ArenaBlock *next = block->next;
+    free (block);
+    block = next;
+  }
+  free (arena);
+}
@@ -0,0 +1,45 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+#include <stdlib.h> // For malloc(), size_t
+
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    char memory[];
+} ArenaBlock;
+
+/**
+ * Bump allocator: memory is handed out from large blocks and is released
+ * all at once by free_arena().
+ */
+typedef struct Arena {
+    ArenaBlock *blocks; // the block currently allocated from comes first
+    size_t block_size;
+    size_t bytes_used;
+} Arena;
+
+/**
+ * Allocate a new empty arena.
+ * @param block_size size of the blocks to allocate from, 0 for the default
+ * @return pointer to the new arena, NULL in case of allocation error
+ */
+Arena *new_arena (size_t block_size);
+
+/**
+ * Allocate size bytes from the arena, aligned for pointers and integers.
+ * @param arena arena to allocate from
+ * @param size number of bytes
+ * @return pointer to the memory, NULL in case of allocation error
+ */
+void *arena_alloc (Arena *arena, size_t size);
+
+/**
+ * Free the arena and all of the memory allocated from it.
+ * @param arena arena to free, may be NULL
+ */
+void free_arena (Arena *arena);
+
+#endif //_ARENA_H_
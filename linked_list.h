@@ -21,4 +21,12 @@ typedef struct LinkedList {
  */
 int add (LinkedList *link_list, void *data);
 
+/**
+ * Add an allocated node (with it's data set) at the end of the given link
+ * list.
+ * @param link_list Link list to add the node to
+ * @param new_node the node, it's next is set to NULL
+ */
+void append_node (LinkedList *link_list, Node *new_node);
+
 #endif //_LINKEDLIST_H_
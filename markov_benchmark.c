@@ -0,0 +1,1332 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime(), mkstemp()
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "markov_chain.h"
+#include "string_chain.h"
+#include "markov_graph.h"
+#include "tokenizer.h"
+#include "ngram_chain.h"
+
+// messages
+#define USAGE_MSG "Usage: markov_benchmark [text_corpus] [repeats] " \
+"[--scale max_words] [--json results_file]\n"
+#define FILE_ERR_MSG "Error: The given file is invalid.\n"
+#define ALLOCATION_ERR_MSG "Allocation failure: there was problem to create markov_chain"
+// constants
+#define DEFAULT_CORPUS "justdoit_tweets.txt"
+#define DEFAULT_REPEATS 3
+#define WALKS 200000
+#define BENCH_THREADS 4
+#define MAX_WORDS_IN_TWEET 20
+#define SEED 1
+#define CHECKSUM_FACTOR 31
+#define TOKENIZE_REPEATS 50
+#define WHITE_SPACE " "
+#define END_LINE "\n"
+#define CORPUS_IND 1
+#define REPEATS_IND 2
+#define MAX_ARGS_NUM 3
+#define DECIMAL 10
+#define NANO_IN_SEC 1e9
+#define OUTPUT_TWEETS 200000
+#define NULL_DEVICE "/dev/null"
+#define BENCH_MAX_ORDER 3
+#define BENCH_MAX_PRUNE_COUNT 4
+#define BENCH_MILD_PRUNE_COUNT 2
+#define BATCH_CHECK_MSG "Error: generate_random_sequences and " \
+"generate_random_sequence_r generated different tweets.\n"
+#define PRUNE_CHECK_MSG "Error: pruning with min count %d dropped all the " \
+"transitions of a kept state (max_deviation=%.4f).\n"
+#define SCALE_OPTION "--scale"
+#define JSON_OPTION "--json"
+// internal: run one measurement (name, corpus, words) in this process
+#define MEASURE_OPTION "--measure"
+#define MEASURE_ARGS_NUM 3
+#define SELF_EXE "/proc/self/exe"
+#define PROC_STATUS "/proc/self/status"
+#define PEAK_RSS_FIELD "VmHWM:"
+#define STATUS_LINE_LEN 256
+#define REPORT_LINE_LEN 512
+#define JSON_NUMBER_CHARS "-0123456789."
+#define DEFAULT_SCALE_MAX_WORDS 1000000
+#define SCALE_MIN_WORDS 10000
+#define SCALE_FACTOR 10
+#define SCALE_TWEETS 100000
+#define ZIPF_VOCABULARY 1000000
+#define ZIPF_WORDS_PER_LINE 15
+#define ZIPF_SENTENCE_LEN 12 // one word in 12 ends a sentence
+#define ZIPF_CORPUS_TEMPLATE "/tmp/markov_zipf_XXXXXX"
+#define MAX_WORD_LEN 16
+#define MICRO_IN_SEC 1e6
+#define PERCENT 100
+
+static double now_sec (void)
+/**
+ * @return monotonic wall-clock time in seconds
+ */
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / NANO_IN_SEC;
+}
+
+// the --json results file, every report is appended to it (NULL if none)
+static FILE *json_results = NULL;
+
+static const char *json_unit (const char *unit)
+/**
+ * @return the suffix, for the JSON key, of a value printed with the given
+ * unit, "" if it has none, NULL if it's not a known unit
+ */
+{
+  const char *units[][2] = {{"", ""}, {"s", "_sec"}, {"us", "_us"},
+                            {"KB", "_kb"}, {"%", "_percent"}};
+  for (size_t i = 0; i < sizeof (units) / sizeof (units[0]); i++)
+  {
+    if (strcmp (unit, units[i][0]) == 0)
+    {
+      return units[i][1];
+    }
+  }
+  return NULL;
+}
+
+static void write_json (FILE *json, char *line)
+/**
+ * Append a report line "bench [variant] key=value ..." to json as a JSON
+ * object with a timestamp: numbers (with a known unit, moved to the key:
+ * "time=0.5s" is "time_sec": 0.5) are JSON numbers, other values strings.
+ * The line is tokenized in place.
+ */
+{
+  fprintf (json, "{\"time\": %ld", (long) time (NULL));
+  const char *name_key = "bench";
+  char *save = NULL;
+  for (char *token = strtok_r (line, WHITE_SPACE END_LINE, &save);
+       token != NULL; token = strtok_r (NULL, WHITE_SPACE END_LINE, &save))
+  {
+    char *value = strchr (token, '=');
+    if (value == NULL)
+    {
+      fprintf (json, ", \"%s\": \"%s\"", name_key, token);
+      name_key = "variant";
+      continue;
+    }
+    *value++ = '\0';
+    fputs (", \"", json);
+    for (char *c = token; *c; c++)
+    {
+      if (*c == '/')
+      {
+        fputs ("_per_", json);
+      }
+      else
+      {
+        fputc (tolower ((unsigned char) *c), json);
+      }
+    }
+    size_t digits = strspn (value, JSON_NUMBER_CHARS);
+    const char *unit = digits ? json_unit (value + digits) : NULL;
+    if (unit == NULL)
+    {
+      fprintf (json, "\": \"%s\"", value);
+    }
+    else
+    {
+      fprintf (json, "%s\": %.*s", unit, (int) digits, value);
+    }
+  }
+  fputs ("}\n", json);
+}
+
+static void record (const char *format, ...)
+/**
+ * Print a result line (printf-like), and append it to the --json results
+ * file if there is one.
+ */
+{
+  char line[REPORT_LINE_LEN];
+  va_list args;
+  va_start (args, format);
+  vsnprintf (line, sizeof (line), format, args);
+  va_end (args);
+  fputs (line, stdout);
+  if (json_results != NULL)
+  {
+    write_json (json_results, line);
+  }
+}
+
+static long count_words (const char *path)
+/**
+ * Count the whitespace separated words of the given file.
+ * @return number of words, -1 if the file can't be opened
+ */
+{
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  long words = 0;
+  int in_word = 0;
+  for (int c = fgetc (fp); c != EOF; c = fgetc (fp))
+  {
+    int is_space = (c == ' ' || c == '\n');
+    words += (!is_space && !in_word);
+    in_word = !is_space;
+  }
+  fclose (fp);
+  return words;
+}
+
+static int bench_ingest (const char *path, bool use_hash, int threads,
+                         long words, int repeats)
+/**
+ * Build a chain from the whole corpus `repeats` times and print the best
+ * time.
+ * @param use_hash whether to keep the chain's hash_func (false measures the
+ * linear database scan)
+ * @param threads number of threads to train with
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  double best = -1;
+  int vocabulary = 0;
+  for (int i = 0; i < repeats; i++)
+  {
+    MarkovChain *markov_chain = new_string_markov_chain ();
+    if (markov_chain == NULL)
+    {
+      printf (ALLOCATION_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+    if (!use_hash)
+    {
+      markov_chain->hash_func = NULL;
+    }
+    double start = now_sec ();
+    if (threads > 1)
+    {
+      fill_database_parallel (path, -1, markov_chain, threads);
+    }
+    else
+    {
+      fill_database_mmap (path, -1, markov_chain);
+    }
+    double elapsed = now_sec () - start;
+    best = (best < 0 || elapsed < best) ? elapsed : best;
+    vocabulary = markov_chain->database->size;
+    free_markov_chain (&markov_chain);
+  }
+  record ("ingest %-7s threads=%d words=%ld vocabulary=%d best=%.4fs "
+          "words/sec=%.0f\n", use_hash ? "hash" : "linear", threads, words,
+          vocabulary, best, words / best);
+  return EXIT_SUCCESS;
+}
+
+typedef size_t (*find_separator_f) (const char *, size_t);
+
+static long tokenize_strtok (const char *path)
+/**
+ * Split the file into words the way fill_database does (fgets, strtok,
+ * strcspn), without adding them to a chain.
+ * @return sum of the lengths of the words
+ */
+{
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    return 0;
+  }
+  char tweet[TWEET_MAX_LEN];
+  long total = 0;
+  while (fgets (tweet, TWEET_MAX_LEN, fp))
+  {
+    for (char *word = strtok (tweet, WHITE_SPACE); word;
+         word = strtok (NULL, WHITE_SPACE))
+    {
+      total += (long) strcspn (word, END_LINE);
+    }
+  }
+  fclose (fp);
+  return total;
+}
+
+static long tokenize_text (const char *text, size_t len,
+                           find_separator_f find)
+/**
+ * Split the text into words like next_token, with the given separator
+ * search.
+ * @return sum of the lengths of the words
+ */
+{
+  long total = 0;
+  size_t pos = 0;
+  while (pos < len)
+  {
+    if (text[pos] == ' ')
+    {
+      pos++;
+      continue;
+    }
+    size_t length = find (text + pos, len - pos);
+    total += (long) length;
+    pos += length + 1;
+  }
+  return total;
+}
+
+static char *read_file (const char *path, size_t *len)
+/**
+ * Read the whole file to a newly allocated buffer.
+ * @return the buffer, NULL on failure
+ */
+{
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  fseek (fp, 0, SEEK_END);
+  long size = ftell (fp);
+  fseek (fp, 0, SEEK_SET);
+  char *text = size >= 0 ? malloc (size + 1) : NULL;
+  if (text != NULL)
+  {
+    *len = fread (text, 1, size, fp);
+  }
+  fclose (fp);
+  return text;
+}
+
+static int bench_tokenize (const char *path)
+/**
+ * Time splitting the corpus into words TOKENIZE_REPEATS times: the strtok
+ * path of fill_database against the scalar and SIMD separator search.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  size_t len = 0;
+  char *text = read_file (path, &len);
+  if (text == NULL)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  const char *names[] = {"strtok", "scalar", "simd"};
+  find_separator_f finders[] = {NULL, find_separator_scalar,
+                                find_separator};
+  for (size_t i = 0; i < sizeof (names) / sizeof (names[0]); i++)
+  {
+    long checksum = 0;
+    double start = now_sec ();
+    for (int j = 0; j < TOKENIZE_REPEATS; j++)
+    {
+      checksum += finders[i] ? tokenize_text (text, len, finders[i])
+                             : tokenize_strtok (path);
+    }
+    double elapsed = now_sec () - start;
+    record ("tokenize %-6s bytes=%zu time=%.4fs MB/sec=%.1f checksum=%ld\n",
+            names[i], len * TOKENIZE_REPEATS, elapsed,
+            len * TOKENIZE_REPEATS / elapsed / 1e6, checksum);
+  }
+  free (text);
+  return EXIT_SUCCESS;
+}
+
+static int bench_ingest_online (const char *path, long words, int repeats)
+/**
+ * Build a chain from the whole corpus `repeats` times, one line per
+ * markov_chain_ingest call, and print the best time.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  size_t len = 0;
+  char *text = read_file (path, &len);
+  if (text == NULL)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  double best = -1;
+  int vocabulary = 0;
+  for (int i = 0; i < repeats; i++)
+  {
+    MarkovChain *markov_chain = new_string_markov_chain ();
+    if (markov_chain == NULL)
+    {
+      printf (ALLOCATION_ERR_MSG);
+      free (text);
+      return EXIT_FAILURE;
+    }
+    double start = now_sec ();
+    for (size_t pos = 0; pos < len;)
+    {
+      const char *end = memchr (text + pos, '\n', len - pos);
+      size_t line_len = end ? (size_t) (end - text) + 1 - pos : len - pos;
+      markov_chain_ingest (markov_chain, text + pos, line_len);
+      pos += line_len;
+    }
+    double elapsed = now_sec () - start;
+    best = (best < 0 || elapsed < best) ? elapsed : best;
+    vocabulary = markov_chain->database->size;
+    free_markov_chain (&markov_chain);
+  }
+  record ("ingest %-7s threads=1 words=%ld vocabulary=%d best=%.4fs "
+          "words/sec=%.0f\n", "online", words, vocabulary, best, words / best);
+  free (text);
+  return EXIT_SUCCESS;
+}
+
+static int bench_teardown (const char *path, int repeats)
+/**
+ * Build a chain from the whole corpus and free it `repeats` times, with the
+ * states allocated one by one (malloc) and from a node arena, and print the
+ * best times.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  for (int use_arena = 0; use_arena <= 1; use_arena++)
+  {
+    double best_build = -1, best_free = -1;
+    for (int i = 0; i < repeats; i++)
+    {
+      MarkovChain *markov_chain = new_string_markov_chain ();
+      if (markov_chain == NULL
+          || (use_arena && !use_node_arena (markov_chain)))
+      {
+        printf (ALLOCATION_ERR_MSG);
+        if (markov_chain != NULL)
+        {
+          free_markov_chain (&markov_chain);
+        }
+        return EXIT_FAILURE;
+      }
+      double start = now_sec ();
+      fill_database_mmap (path, -1, markov_chain);
+      double built = now_sec ();
+      free_markov_chain (&markov_chain);
+      double freed = now_sec ();
+      best_build = (best_build < 0 || built - start < best_build)
+                   ? built - start : best_build;
+      best_free = (best_free < 0 || freed - built < best_free)
+                  ? freed - built : best_free;
+    }
+    record ("alloc %-7s build=%.4fs free=%.6fs\n",
+            use_arena ? "arena" : "malloc", best_build, best_free);
+  }
+  return EXIT_SUCCESS;
+}
+
+static int bench_orders (const char *path)
+/**
+ * Train chains of order 1 to BENCH_MAX_ORDER on the corpus and print their
+ * size: states, transitions and memory (per state, vocabulary included).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  for (int order = 1; order <= BENCH_MAX_ORDER; order++)
+  {
+    NGramChain *ngram_chain = new_ngram_chain (order);
+    if (ngram_chain == NULL)
+    {
+      printf (ALLOCATION_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+    double start = now_sec ();
+    fill_ngram_chain (path, -1, ngram_chain);
+    double elapsed = now_sec () - start;
+    const MarkovChain *markov_chain = ngram_chain->markov_chain;
+    long edges = 0;
+    for (int i = 0; i < markov_chain->database->size; i++)
+    {
+      edges += markov_chain->nodes[i]->len_counter_list;
+    }
+    int states = markov_chain->database->size;
+    size_t bytes = ngram_chain_memory (ngram_chain);
+    record ("order %d states=%d edges=%ld vocabulary=%d time=%.4fs bytes=%zu "
+            "bytes/state=%.1f\n", order, states, edges,
+            ngram_chain->vocabulary->database->size, elapsed, bytes,
+            states ? (double) bytes / states : 0.0);
+    free_ngram_chain (&ngram_chain);
+  }
+  return EXIT_SUCCESS;
+}
+
+static unsigned long walk (MarkovChain *markov_chain, int *length)
+/**
+ * Walk the chain like generate_random_sequence, without printing.
+ * @param length incremented by the number of states visited
+ * @return checksum of the ids of the visited states
+ */
+{
+  int ids[MAX_WORDS_IN_TWEET];
+  int walk_length = generate_random_walk (markov_chain, NULL,
+                                          MAX_WORDS_IN_TWEET, ids, NULL,
+                                          NULL);
+  unsigned long checksum = 0;
+  for (int i = 0; i < walk_length; i++)
+  {
+    checksum = checksum * CHECKSUM_FACTOR + ids[i];
+  }
+  *length += walk_length;
+  return checksum;
+}
+
+static unsigned long graph_walk (const MarkovGraph *graph, int *length)
+/**
+ * Walk the compiled graph, the same way walk() walks the chain.
+ */
+{
+  int nodes[MAX_WORDS_IN_TWEET];
+  int walk_length = graph_random_walk (graph, NO_NODE, MAX_WORDS_IN_TWEET,
+                                       nodes);
+  unsigned long checksum = 0;
+  for (int i = 0; i < walk_length; i++)
+  {
+    checksum = checksum * CHECKSUM_FACTOR + nodes[i];
+  }
+  *length += walk_length;
+  return checksum;
+}
+
+static void report_sampling (const char *name, double start, int steps,
+                             unsigned long checksum)
+{
+  double elapsed = now_sec () - start;
+  record ("sample %-7s walks=%d steps=%d time=%.4fs steps/sec=%.0f "
+          "checksum=0x%lx\n", name, WALKS, steps, elapsed, steps / elapsed,
+          checksum);
+}
+
+static int bench_graph (MarkovChain *markov_chain)
+/**
+ * Time WALKS random walks over the compiled (CSR) form of the chain, with
+ * exact weights and quantized to 16 and 8 bits (as they are, then
+ * renormalized), and print the memory and largest deviation of the
+ * quantized graphs. Quantizing losslessly keeps the checksum.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  static const char *const names[] = {"csr", "csr-q16", "csr-q8", "csr-q8n"};
+  static const int bits[] = {EXACT_WEIGHTS, WEIGHTS_16_BITS, WEIGHTS_8_BITS,
+                             WEIGHTS_8_BITS};
+  static const bool renormalized[] = {false, false, false, true};
+  for (int mode = 0; mode < (int) (sizeof (bits) / sizeof (bits[0])); mode++)
+  {
+    MarkovGraph *graph = compile_markov_chain (markov_chain);
+    size_t bytes = graph ? markov_graph_memory (graph) : 0;
+    double max_deviation = 0;
+    if (graph == NULL || (bits[mode] != EXACT_WEIGHTS && !quantize_markov_graph
+        (graph, bits[mode], renormalized[mode], &max_deviation)))
+    {
+      printf (ALLOCATION_ERR_MSG);
+      free_markov_graph (&graph);
+      return EXIT_FAILURE;
+    }
+    if (bits[mode] != EXACT_WEIGHTS)
+    {
+      record ("quantize bits=%d renormalize=%d bytes=%zu->%zu "
+              "max_deviation=%.6f\n", bits[mode], renormalized[mode], bytes,
+              markov_graph_memory (graph), max_deviation);
+    }
+    srand (SEED);
+    int steps = 0;
+    unsigned long checksum = 0;
+    double start = now_sec ();
+    for (int i = 0; i < WALKS; i++)
+    {
+      checksum ^= graph_walk (graph, &steps) + i;
+    }
+    report_sampling (names[mode], start, steps, checksum);
+    free_markov_graph (&graph);
+  }
+  return EXIT_SUCCESS;
+}
+
+static void generate_tweets (MarkovChain *markov_chain)
+/**
+ * Generate OUTPUT_TWEETS tweets the way tweets_generator does, to the
+ * chain's sink if it has one, otherwise to the standard output.
+ */
+{
+  srand (SEED);
+  for (int i = 1; i <= OUTPUT_TWEETS; i++)
+  {
+    if (markov_chain->sink)
+    {
+      sink_write_str (markov_chain->sink, "Tweet ");
+      sink_write_long (markov_chain->sink, i);
+      sink_write_str (markov_chain->sink, ":");
+    }
+    else
+    {
+      printf ("Tweet %d:", i);
+    }
+    generate_random_sequence (markov_chain, NULL, MAX_WORDS_IN_TWEET);
+  }
+}
+
+static int bench_output (MarkovChain *markov_chain)
+/**
+ * Time generating OUTPUT_TWEETS tweets to NULL_DEVICE: with printf (the
+ * standard output redirected there), through a file sink, and to a memory
+ * sink.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  fflush (stdout);
+  int null_fd = open (NULL_DEVICE, O_WRONLY);
+  int stdout_fd = dup (STDOUT_FILENO);
+  if (null_fd < 0 || stdout_fd < 0)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  double start = now_sec ();
+  dup2 (null_fd, STDOUT_FILENO);
+  generate_tweets (markov_chain);
+  fflush (stdout);
+  double elapsed = now_sec () - start;
+  dup2 (stdout_fd, STDOUT_FILENO);
+  close (stdout_fd);
+  record ("output printf  tweets=%d time=%.4fs tweets/sec=%.0f\n",
+          OUTPUT_TWEETS, elapsed, OUTPUT_TWEETS / elapsed);
+  int fds[] = {null_fd, NO_FD};
+  for (size_t i = 0; i < sizeof (fds) / sizeof (fds[0]); i++)
+  {
+    markov_chain->sink = new_output_sink (fds[i], SINK_DEFAULT_CAPACITY);
+    if (markov_chain->sink == NULL)
+    {
+      printf (ALLOCATION_ERR_MSG);
+      close (null_fd);
+      return EXIT_FAILURE;
+    }
+    start = now_sec ();
+    generate_tweets (markov_chain);
+    sink_flush (markov_chain->sink);
+    elapsed = now_sec () - start;
+    record ("output %-7s tweets=%d time=%.4fs tweets/sec=%.0f bytes=%zu\n",
+            fds[i] == NO_FD ? "memory" : "sink", OUTPUT_TWEETS, elapsed,
+            OUTPUT_TWEETS / elapsed, markov_chain->sink->len);
+    free_output_sink (markov_chain->sink);
+    markov_chain->sink = NULL;
+  }
+  close (null_fd);
+  return EXIT_SUCCESS;
+}
+
+static void write_sequences (const MarkovChain *markov_chain, void **data,
+                             const int *lengths, OutputSink *sink)
+/**
+ * Write the OUTPUT_TWEETS walks of generate_random_sequences to the sink,
+ * the way generate_random_sequence_r writes a walk.
+ */
+{
+  for (int i = 0; i < OUTPUT_TWEETS; i++)
+  {
+    void **walk = data + (size_t) i * MAX_WORDS_IN_TWEET;
+    for (int j = 0; j < lengths[i]; j++)
+    {
+      markov_chain->write_func (walk[j], sink);
+    }
+    sink_write_str (sink, END_LINE);
+  }
+}
+
+static int bench_batch (MarkovChain *markov_chain)
+/**
+ * Time generating OUTPUT_TWEETS tweets to memory sinks from one stream:
+ * with a generate_random_sequence_r call per tweet, and with one
+ * generate_random_sequences call (the walks written after). The two must
+ * write the same bytes.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  static const char *const names[] = {"single", "batch"};
+  void **data = malloc ((size_t) OUTPUT_TWEETS * MAX_WORDS_IN_TWEET
+                        * sizeof (void *));
+  int *lengths = malloc (OUTPUT_TWEETS * sizeof (int));
+  OutputSink *sinks[] = {new_output_sink (NO_FD, SINK_DEFAULT_CAPACITY),
+                         new_output_sink (NO_FD, SINK_DEFAULT_CAPACITY)};
+  int result = EXIT_SUCCESS;
+  if (data == NULL || lengths == NULL || sinks[0] == NULL || sinks[1] == NULL)
+  {
+    printf (ALLOCATION_ERR_MSG);
+    result = EXIT_FAILURE;
+  }
+  for (int batched = 0; result == EXIT_SUCCESS && batched <= 1; batched++)
+  {
+    RandomStream stream;
+    seed_random_stream (&stream, SEED, 0);
+    double start = now_sec ();
+    if (batched)
+    {
+      generate_random_sequences (markov_chain, OUTPUT_TWEETS,
+                                 MAX_WORDS_IN_TWEET, NULL, data, lengths,
+                                 &stream);
+      write_sequences (markov_chain, data, lengths, sinks[batched]);
+    }
+    else
+    {
+      markov_chain->sink = sinks[batched];
+      for (int i = 0; i < OUTPUT_TWEETS; i++)
+      {
+        generate_random_sequence_r (markov_chain, NULL, MAX_WORDS_IN_TWEET,
+                                    &stream);
+      }
+      markov_chain->sink = NULL;
+    }
+    double elapsed = now_sec () - start;
+    record ("batch    %-7s tweets=%d time=%.4fs tweets/sec=%.0f bytes=%zu\n",
+            names[batched], OUTPUT_TWEETS, elapsed, OUTPUT_TWEETS / elapsed,
+            sinks[batched]->len);
+  }
+  if (result == EXIT_SUCCESS && (sinks[0]->failed || sinks[1]->failed
+      || sinks[0]->len != sinks[1]->len
+      || memcmp (sinks[0]->buffer, sinks[1]->buffer, sinks[0]->len) != 0))
+  {
+    printf (BATCH_CHECK_MSG);
+    result = EXIT_FAILURE;
+  }
+  for (int i = 0; i < (int) (sizeof (sinks) / sizeof (sinks[0])); i++)
+  {
+    if (sinks[i] != NULL)
+    {
+      free_output_sink (sinks[i]);
+    }
+  }
+  free (data);
+  free (lengths);
+  return result;
+}
+
+static int bench_prune (const char *path)
+/**
+ * Prune chains trained on the corpus with min counts 2 to
+ * BENCH_MAX_PRUNE_COUNT (see prune_markov_chain) and print what was
+ * removed: states, transitions, memory and how much the distribution
+ * changed. Mild pruning (min count up to BENCH_MILD_PRUNE_COUNT) must leave
+ * every kept state some of it's distribution (max_deviation below 1).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  for (int count = 2; count <= BENCH_MAX_PRUNE_COUNT; count++)
+  {
+    MarkovChain *markov_chain = new_string_markov_chain ();
+    if (markov_chain == NULL || !use_node_arena (markov_chain))
+    {
+      printf (ALLOCATION_ERR_MSG);
+      if (markov_chain != NULL)
+      {
+        free_markov_chain (&markov_chain);
+      }
+      return EXIT_FAILURE;
+    }
+    fill_database_mmap (path, -1, markov_chain);
+    PruneReport report;
+    double start = now_sec ();
+    bool pruned = prune_markov_chain (markov_chain, count, count, 0, &report);
+    double elapsed = now_sec () - start;
+    free_markov_chain (&markov_chain);
+    if (!pruned)
+    {
+      printf (ALLOCATION_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+    record ("prune count=%d states=%d->%d edges=%ld->%ld bytes=%zu->%zu "
+            "saved=%.1f%% removed=%.2f%% max_deviation=%.4f time=%.4fs\n",
+            count, report.states_before, report.states_after,
+            report.edges_before, report.edges_after, report.bytes_before,
+            report.bytes_after, PERCENT * (1 - (double) report.bytes_after
+                                                / report.bytes_before),
+            PERCENT * report.mass_removed, report.max_deviation, elapsed);
+    if (count <= BENCH_MILD_PRUNE_COUNT && report.max_deviation >= 1)
+    {
+      printf (PRUNE_CHECK_MSG, count, report.max_deviation);
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+static int bench_sampling (const char *path)
+/**
+ * Time WALKS random walks over the corpus chain: compiled, and before and
+ * after freezing it. The compiled and mutable walks have the same checksum.
+ * Then time the output of the tweets (see bench_output), and generating
+ * them in one batch (see bench_batch).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  MarkovChain *markov_chain = new_string_markov_chain ();
+  if (markov_chain == NULL)
+  {
+    printf (ALLOCATION_ERR_MSG);
+    fclose (fp);
+    return EXIT_FAILURE;
+  }
+  if (fill_database (fp, -1, markov_chain)) // closes fp
+  {
+    printf (ALLOCATION_ERR_MSG);
+    free_markov_chain (&markov_chain);
+    return EXIT_FAILURE;
+  }
+  if (bench_graph (markov_chain))
+  {
+    free_markov_chain (&markov_chain);
+    return EXIT_FAILURE;
+  }
+  for (int frozen = 0; frozen <= 1; frozen++)
+  {
+    if (frozen && !freeze_markov_chain (markov_chain))
+    {
+      printf (ALLOCATION_ERR_MSG);
+      free_markov_chain (&markov_chain);
+      return EXIT_FAILURE;
+    }
+    srand (SEED);
+    int steps = 0;
+    unsigned long checksum = 0;
+    double start = now_sec ();
+    for (int i = 0; i < WALKS; i++)
+    {
+      checksum ^= walk (markov_chain, &steps) + i;
+    }
+    report_sampling (frozen ? "frozen" : "mutable", start, steps, checksum);
+  }
+  int result = bench_output (markov_chain);
+  if (result == EXIT_SUCCESS)
+  {
+    result = bench_batch (markov_chain);
+  }
+  free_markov_chain (&markov_chain);
+  return result;
+}
+
+static char **split_words (char *text, size_t len, long *num_words)
+/**
+ * Split the text into words in place, like the chain is trained on it (see
+ * next_token): every word is NUL terminated over the separator after it.
+ * @param text the text, with room for a NUL after len bytes
+ * @return array of the words, NULL in case of allocation error
+ */
+{
+  long capacity = 1;
+  char **words = malloc (capacity * sizeof (char *));
+  size_t pos = 0;
+  Token token;
+  *num_words = 0;
+  while (words != NULL && next_token (text, len, &pos, &token))
+  {
+    if (*num_words == capacity)
+    {
+      capacity *= 2;
+      char **grown = realloc (words, capacity * sizeof (char *));
+      if (grown == NULL)
+      {
+        free (words);
+        return NULL;
+      }
+      words = grown;
+    }
+    text[token.offset + token.length] = 0;
+    words[(*num_words)++] = text + token.offset;
+  }
+  return words;
+}
+
+static unsigned long lookup_words (MarkovChain *markov_chain, char **words,
+                                   long num_words, bool specialized)
+/**
+ * Look up all the words, with get_node_from_database or its string
+ * specialization (get_string_node).
+ * @return checksum of the ids of the found states
+ */
+{
+  unsigned long checksum = 0;
+  if (specialized)
+  {
+    for (long i = 0; i < num_words; i++)
+    {
+      checksum = checksum * CHECKSUM_FACTOR
+                 + get_string_node (markov_chain, words[i])->data->id;
+    }
+  }
+  else
+  {
+    for (long i = 0; i < num_words; i++)
+    {
+      checksum = checksum * CHECKSUM_FACTOR
+                 + get_node_from_database (markov_chain, words[i])->data->id;
+    }
+  }
+  return checksum;
+}
+
+static bool generate_to_memory (MarkovChain *markov_chain, bool specialized,
+                                size_t *bytes)
+/**
+ * Generate OUTPUT_TWEETS tweets to a memory sink, with
+ * generate_random_sequence_r or its string specialization
+ * (generate_string_sequence), tweet i from stream i.
+ * @param bytes set to the number of bytes generated
+ * @return true on success, false in case of allocation error
+ */
+{
+  markov_chain->sink = new_output_sink (NO_FD, SINK_DEFAULT_CAPACITY);
+  if (markov_chain->sink == NULL)
+  {
+    return false;
+  }
+  for (int i = 1; i <= OUTPUT_TWEETS; i++)
+  {
+    RandomStream stream;
+    seed_random_stream (&stream, SEED, (unsigned long) i);
+    if (specialized)
+    {
+      generate_string_sequence (markov_chain, NULL, MAX_WORDS_IN_TWEET,
+                                &stream);
+    }
+    else
+    {
+      generate_random_sequence_r (markov_chain, NULL, MAX_WORDS_IN_TWEET,
+                                  &stream);
+    }
+  }
+  *bytes = markov_chain->sink->len;
+  free_output_sink (markov_chain->sink);
+  markov_chain->sink = NULL;
+  return true;
+}
+
+static int bench_specialized (const char *path)
+/**
+ * Compare the generic chain functions, that call the callbacks through the
+ * chain's pointers, with their string specialization (see
+ * MARKOV_CHAIN_TEMPLATE): time looking up every word of the corpus
+ * TOKENIZE_REPEATS times, and generating OUTPUT_TWEETS tweets to memory.
+ * Both give the same checksum and output size.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  size_t len = 0;
+  char *text = read_file (path, &len);
+  if (text == NULL)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  long num_words = 0;
+  char **words = split_words (text, len, &num_words);
+  MarkovChain *markov_chain = new_string_markov_chain ();
+  if (words == NULL || markov_chain == NULL)
+  {
+    printf (ALLOCATION_ERR_MSG);
+    free (words);
+    free (text);
+    return EXIT_FAILURE;
+  }
+  fill_database_mmap (path, -1, markov_chain);
+  int result = EXIT_SUCCESS;
+  for (int specialized = 0; specialized <= 1; specialized++)
+  {
+    const char *name = specialized ? "special" : "generic";
+    unsigned long checksum = 0;
+    double start = now_sec ();
+    for (int i = 0; i < TOKENIZE_REPEATS; i++)
+    {
+      checksum = checksum * CHECKSUM_FACTOR
+                 + lookup_words (markov_chain, words, num_words, specialized);
+    }
+    double elapsed = now_sec () - start;
+    record ("lookup   %-7s lookups=%ld time=%.4fs lookups/sec=%.0f "
+            "checksum=0x%lx\n", name, num_words * TOKENIZE_REPEATS,
+            elapsed, num_words * TOKENIZE_REPEATS / elapsed, checksum);
+    size_t bytes = 0;
+    start = now_sec ();
+    if (!generate_to_memory (markov_chain, specialized, &bytes))
+    {
+      printf (ALLOCATION_ERR_MSG);
+      result = EXIT_FAILURE;
+      break;
+    }
+    elapsed = now_sec () - start;
+    record ("generate %-7s tweets=%d time=%.4fs tweets/sec=%.0f bytes=%zu\n",
+            name, OUTPUT_TWEETS, elapsed, OUTPUT_TWEETS / elapsed, bytes);
+  }
+  free_markov_chain (&markov_chain);
+  free (words);
+  free (text);
+  return result;
+}
+
+static int compare_doubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double percentile (const double *sorted, int len, int percent)
+/**
+ * @param sorted len values in increasing order, len > 0
+ * @return the value under which percent percent of the values are
+ */
+{
+  long rank = (long) len * percent / PERCENT;
+  return sorted[rank < len ? rank : len - 1];
+}
+
+static char *write_zipf_word (char *out, int rank, bool sentence_end,
+                              char separator)
+/**
+ * Write the word of the given rank ("w<rank>"), with a dot if it ends a
+ * sentence, and the separator.
+ * @return the end of the written word
+ */
+{
+  char digits[MAX_WORD_LEN];
+  int len = 0;
+  do
+  {
+    digits[len++] = (char) ('0' + rank % DECIMAL);
+    rank /= DECIMAL;
+  }
+  while (rank > 0);
+  *out++ = 'w';
+  while (len > 0)
+  {
+    *out++ = digits[--len];
+  }
+  if (sentence_end)
+  {
+    *out++ = '.';
+  }
+  *out++ = separator;
+  return out;
+}
+
+static bool write_zipf_corpus (int fd, long words)
+/**
+ * Write a synthetic corpus of the given number of words to fd: the word of
+ * rank r (of ZIPF_VOCABULARY) is drawn with probability proportional to 1/r
+ * (Zipf's law, exponent 1), one word in ZIPF_SENTENCE_LEN ends a sentence
+ * and every line has ZIPF_WORDS_PER_LINE words. The corpus only depends on
+ * the number of words.
+ * @return true on success, false in case of allocation or write error
+ */
+{
+  double *cdf = malloc (ZIPF_VOCABULARY * sizeof (double));
+  OutputSink *sink = new_output_sink (fd, 0);
+  bool success = cdf != NULL && sink != NULL;
+  double sum = 0;
+  for (int rank = 1; success && rank <= ZIPF_VOCABULARY; rank++)
+  {
+    sum += 1.0 / rank;
+    cdf[rank - 1] = sum;
+  }
+  RandomStream stream;
+  seed_random_stream (&stream, SEED, (unsigned long) words);
+  for (long i = 0; success && i < words; i++)
+  {
+    double u = random_stream_number (&stream, INT_MAX) / (double) INT_MAX
+               * sum;
+    int low = 0, high = ZIPF_VOCABULARY - 1;
+    while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      if (cdf[mid] > u)
+      {
+        high = mid;
+      }
+      else
+      {
+        low = mid + 1;
+      }
+    }
+    char word[MAX_WORD_LEN];
+    bool sentence_end = random_stream_number (&stream, ZIPF_SENTENCE_LEN)
+                        == 0;
+    char separator = (i + 1) % ZIPF_WORDS_PER_LINE ? ' ' : '\n';
+    char *end = write_zipf_word (word, low + 1, sentence_end, separator);
+    sink_write (sink, word, end - word);
+  }
+  if (sink != NULL && !free_output_sink (sink))
+  {
+    success = false;
+  }
+  free (cdf);
+  return success;
+}
+
+static long peak_rss_kb (void)
+/**
+ * @return the peak resident set size of the process' memory, in KB: it's
+ * VmHWM, which starts over on exec (unlike ru_maxrss, which keeps the
+ * maximum of the process before the exec, here the whole benchmark's), or
+ * ru_maxrss if there is no /proc
+ */
+{
+  char line[STATUS_LINE_LEN];
+  long peak = -1;
+  FILE *status = fopen (PROC_STATUS, "r");
+  while (status != NULL && peak < 0 && fgets (line, sizeof (line), status))
+  {
+    if (strncmp (line, PEAK_RSS_FIELD, strlen (PEAK_RSS_FIELD)) == 0)
+    {
+      peak = strtol (line + strlen (PEAK_RSS_FIELD), NULL, DECIMAL);
+    }
+  }
+  if (status != NULL)
+  {
+    fclose (status);
+  }
+  if (peak < 0)
+  {
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    peak = usage.ru_maxrss;
+  }
+  return peak;
+}
+
+static int measure_corpus (const char *name, const char *path, long words,
+                           const char *json_path)
+/**
+ * Measure the whole pipeline on the corpus: train a chain (with a node
+ * arena), generate SCALE_TWEETS tweets to a memory sink timing every tweet,
+ * and free the chain. Prints a line of results, and appends it as a JSON
+ * object to json_path if it's not NULL. Run by a fresh process of its own
+ * (see run_measurement), so the peak RSS is the corpus'.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
+ */
+{
+  MarkovChain *markov_chain = new_string_markov_chain ();
+  OutputSink *sink = new_output_sink (NO_FD, 0);
+  double *latency = malloc (SCALE_TWEETS * sizeof (double));
+  if (markov_chain == NULL || sink == NULL || latency == NULL
+      || !use_node_arena (markov_chain))
+  {
+    printf (ALLOCATION_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  double start = now_sec ();
+  fill_database_mmap (path, -1, markov_chain);
+  double ingest = now_sec () - start;
+  long edges = 0;
+  for (int i = 0; i < markov_chain->database->size; i++)
+  {
+    edges += markov_chain->nodes[i]->len_counter_list;
+  }
+  int vocabulary = markov_chain->database->size;
+  size_t bytes = markov_chain_memory (markov_chain);
+  int tweets = markov_chain->num_start_nodes > 0 ? SCALE_TWEETS : 0;
+  markov_chain->sink = sink;
+  srand (SEED);
+  start = now_sec ();
+  for (int i = 0; i < tweets; i++)
+  {
+    double tweet_start = now_sec ();
+    sink_write_str (sink, "Tweet ");
+    sink_write_long (sink, i + 1);
+    sink_write_str (sink, ":");
+    generate_random_sequence (markov_chain, NULL, MAX_WORDS_IN_TWEET);
+    latency[i] = now_sec () - tweet_start;
+    if (sink->len >= SINK_DEFAULT_CAPACITY)
+    {
+      sink_reset (sink);
+    }
+  }
+  double generate = now_sec () - start;
+  start = now_sec ();
+  free_markov_chain (&markov_chain);
+  double teardown = now_sec () - start;
+  qsort (latency, tweets, sizeof (double), compare_doubles);
+  double p50 = tweets ? percentile (latency, tweets, 50) : 0;
+  double p99 = tweets ? percentile (latency, tweets, 99) : 0;
+  double worst = tweets ? latency[tweets - 1] : 0;
+  long peak_rss = peak_rss_kb ();
+  printf ("scale %-9s words=%ld vocabulary=%d edges=%ld bytes=%zu "
+          "words/sec=%.0f tweets/sec=%.0f p50=%.2fus p99=%.2fus max=%.2fus "
+          "free=%.4fs peak_rss=%ldKB\n", name, words, vocabulary, edges, bytes,
+          words / ingest, tweets / generate, p50 * MICRO_IN_SEC,
+          p99 * MICRO_IN_SEC, worst * MICRO_IN_SEC, teardown, peak_rss);
+  FILE *json = json_path ? fopen (json_path, "a") : NULL;
+  if (json != NULL)
+  {
+    fprintf (json, "{\"bench\": \"scale\", \"corpus\": \"%s\", "
+                   "\"time\": %ld, \"words\": %ld, \"vocabulary\": %d, "
+                   "\"edges\": %ld, \"bytes\": %zu, \"ingest_sec\": %.6f, "
+                   "\"words_per_sec\": %.0f, \"tweets\": %d, "
+                   "\"tweets_per_sec\": %.0f, \"latency_p50_us\": %.3f, "
+                   "\"latency_p99_us\": %.3f, \"latency_max_us\": %.3f, "
+                   "\"free_sec\": %.6f, \"peak_rss_kb\": %ld}\n",
+             name, (long) time (NULL), words, vocabulary, edges, bytes,
+             ingest, words / ingest, tweets, tweets / generate,
+             p50 * MICRO_IN_SEC, p99 * MICRO_IN_SEC, worst * MICRO_IN_SEC,
+             teardown, peak_rss);
+    fclose (json);
+  }
+  free_output_sink (sink);
+  free (latency);
+  return EXIT_SUCCESS;
+}
+
+static int run_measurement (const char *name, const char *path, long words,
+                            const char *json_path)
+/**
+ * Run measure_corpus in a fresh process: the benchmark itself, executed
+ * with MEASURE_OPTION (a forked child would start with the memory, and the
+ * peak RSS, of all the benchmarks run before), and wait for it.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  char words_arg[MAX_WORD_LEN + MAX_WORD_LEN];
+  snprintf (words_arg, sizeof (words_arg), "%ld", words);
+  char *args[] = {SELF_EXE, MEASURE_OPTION, (char *) name, (char *) path,
+                  words_arg, json_path ? JSON_OPTION : NULL,
+                  (char *) json_path, NULL};
+  fflush (NULL); // the results before the measurement's
+  pid_t pid = fork ();
+  if (pid < 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (pid == 0)
+  {
+    execv (SELF_EXE, args);
+    _exit (EXIT_FAILURE);
+  }
+  int status;
+  return waitpid (pid, &status, 0) == pid && WIFEXITED (status)
+         && WEXITSTATUS (status) == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int bench_scale (const char *path, long words, long max_words,
+                        const char *json_path)
+/**
+ * Measure training and generation (see measure_corpus) on the corpus, and
+ * on synthetic Zipf corpora (see write_zipf_corpus) of SCALE_MIN_WORDS words
+ * up to max_words words, growing by SCALE_FACTOR.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  if (run_measurement ("corpus", path, words, json_path))
+  {
+    return EXIT_FAILURE;
+  }
+  for (long size = SCALE_MIN_WORDS; size <= max_words; size *= SCALE_FACTOR)
+  {
+    char corpus[] = ZIPF_CORPUS_TEMPLATE;
+    int fd = mkstemp (corpus);
+    if (fd < 0)
+    {
+      printf (FILE_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+    bool written = write_zipf_corpus (fd, size);
+    close (fd);
+    char name[MAX_WORD_LEN + MAX_WORD_LEN];
+    snprintf (name, sizeof (name), "zipf-%ld", size);
+    int result = written ? run_measurement (name, corpus, size, json_path)
+                         : EXIT_FAILURE;
+    unlink (corpus);
+    if (result)
+    {
+      printf (FILE_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
+{
+  long max_words = DEFAULT_SCALE_MAX_WORDS;
+  const char *json_path = NULL;
+  char **measure = NULL;
+  int kept = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp (argv[i], SCALE_OPTION) == 0 && i + 1 < argc)
+    {
+      max_words = strtol (argv[++i], NULL, DECIMAL);
+    }
+    else if (strcmp (argv[i], JSON_OPTION) == 0 && i + 1 < argc)
+    {
+      json_path = argv[++i];
+    }
+    else if (strcmp (argv[i], MEASURE_OPTION) == 0
+             && i + MEASURE_ARGS_NUM < argc)
+    {
+      measure = argv + i + 1;
+      i += MEASURE_ARGS_NUM;
+    }
+    else
+    {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  if (measure)
+  {
+    return measure_corpus (measure[0], measure[1],
+                           strtol (measure[2], NULL, DECIMAL), json_path);
+  }
+  if (argc > MAX_ARGS_NUM)
+  {
+    printf (USAGE_MSG);
+    return EXIT_FAILURE;
+  }
+  const char *path = argc > CORPUS_IND ? argv[CORPUS_IND] : DEFAULT_CORPUS;
+  int repeats = argc > REPEATS_IND
+                ? (int) strtol (argv[REPEATS_IND], NULL, DECIMAL)
+                : DEFAULT_REPEATS;
+  long words = count_words (path);
+  if (words < 0)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  repeats = repeats > 0 ? repeats : 1;
+  json_results = json_path ? fopen (json_path, "a") : NULL;
+  if (json_path != NULL && json_results == NULL)
+  {
+    printf (FILE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  int result = EXIT_SUCCESS;
+  if (bench_tokenize (path)
+      || bench_ingest (path, true, 1, words, repeats)
+      || bench_ingest (path, true, BENCH_THREADS, words, repeats)
+      || bench_ingest_online (path, words, repeats)
+      || bench_ingest (path, false, 1, words, repeats)
+      || bench_teardown (path, repeats)
+      || bench_orders (path) || bench_prune (path)
+      || bench_sampling (path) || bench_specialized (path)
+      || bench_scale (path, words, max_words, json_path))
+  {
+    result = EXIT_FAILURE;
+  }
+  if (json_results != NULL)
+  {
+    fclose (json_results);
+  }
+  return result;
+}
@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include "markov_chain.h"
+#include "markov_stats.h"
+#include "markov_chain_template.h"
 #include <string.h>
+#include <limits.h>
 
 /**
 * Get random number between 0 and max_number [0, max_number).
@@ -13,6 +16,223 @@ int get_random_number (int max_number)
   return x % max_number;
 }
 
+int get_random_number_r (int max_number, RandomStream *stream)
+{
+  if (stream == NULL)
+  {
+    return get_random_number (max_number);
+  }
+  return random_stream_number (stream, max_number);
+}
+
+#define COUNTER_LIST_INITIAL_CAPACITY 2
+#define INDEX_INITIAL_CAPACITY 64
+#define INDEX_MAX_LOAD_NUM 1 // grow when size / capacity exceeds 1/2
+#define INDEX_MAX_LOAD_DEN 2
+#define NODE_ARENA_BLOCK_SIZE (1 << 20)
+#define PRUNED -1 // new id of a state prune_markov_chain drops
+
+static void *node_alloc (MarkovChain *markov_chain, size_t size)
+/**
+ * Allocate memory for a state or it's counter storage: from the chain's node
+ * arena if it has one, otherwise with malloc.
+ */
+{
+  STATS_ADD (allocations, 1);
+  STATS_ADD (allocated_bytes, size);
+  if (markov_chain->node_arena)
+  {
+    return arena_alloc (markov_chain->node_arena, size);
+  }
+  return malloc (size);
+}
+
+static void *node_realloc (MarkovChain *markov_chain, void *memory,
+                           size_t old_size, size_t size)
+/**
+ * Grow memory allocated by node_alloc. In an arena it's copied to a new
+ * allocation, the old one stays unused until the arena is freed.
+ */
+{
+  STATS_ADD (allocations, 1);
+  STATS_ADD (allocated_bytes, size);
+  if (markov_chain->node_arena == NULL)
+  {
+    return realloc (memory, size);
+  }
+  void *grown = arena_alloc (markov_chain->node_arena, size);
+  if (grown && memory)
+  {
+    memcpy (grown, memory, old_size);
+  }
+  return grown;
+}
+
+static void node_free (MarkovChain *markov_chain, void *memory)
+/**
+ * Free memory allocated by node_alloc (nothing to do in an arena).
+ */
+{
+  if (markov_chain->node_arena == NULL)
+  {
+    free (memory);
+  }
+}
+
+static DatabaseIndex *new_index (int capacity)
+/**
+ * Allocate an empty index.
+ * @param capacity number of slots, must be a power of 2
+ * @return pointer to the new index, NULL in case of allocation error
+ */
+{
+  STATS_ADD (allocations, 1);
+  STATS_ADD (allocated_bytes, capacity * (sizeof (Node *)
+                                          + sizeof (unsigned long)));
+  DatabaseIndex *index = malloc (sizeof (DatabaseIndex));
+  if (index == NULL)
+  {
+    return NULL;
+  }
+  *index = (DatabaseIndex) {calloc (capacity, sizeof (Node *)),
+                            malloc (capacity * sizeof (unsigned long)),
+                            capacity, 0};
+  if (index->slots == NULL || index->hashes == NULL)
+  {
+    free (index->slots);
+    free (index->hashes);
+    free (index);
+    return NULL;
+  }
+  return index;
+}
+
+static void free_index (DatabaseIndex *index)
+{
+  if (index == NULL)
+  {
+    return;
+  }
+  free (index->slots);
+  free (index->hashes);
+  free (index);
+}
+
+static void index_put (DatabaseIndex *index, Node *node, unsigned long hash)
+/**
+ * Put node in the first free slot of its probe sequence. The index must
+ * have a free slot and must not contain node already.
+ */
+{
+  unsigned long mask = (unsigned long) index->capacity - 1;
+  unsigned long slot = hash & mask;
+  while (index->slots[slot] != NULL)
+  {
+    slot = (slot + 1) & mask;
+  }
+  index->slots[slot] = node;
+  index->hashes[slot] = hash;
+  index->size++;
+}
+
+static bool index_grow (DatabaseIndex *index)
+/**
+ * Double the capacity of the index, reusing the cached hashes.
+ * @return true on success, false in case of allocation error (the index is
+ * left unchanged)
+ */
+{
+  DatabaseIndex *bigger = new_index (index->capacity * 2);
+  if (bigger == NULL)
+  {
+    return false;
+  }
+  for (int i = 0; i < index->capacity; i++)
+  {
+    if (index->slots[i] != NULL)
+    {
+      index_put (bigger, index->slots[i], index->hashes[i]);
+    }
+  }
+  free (index->slots);
+  free (index->hashes);
+  *index = *bigger;
+  free (bigger);
+  return true;
+}
+
+static bool index_insert (DatabaseIndex *index, Node *node,
+                          unsigned long hash)
+/**
+ * Insert node to the index, growing it if needed.
+ * @return true on success, false in case of allocation error
+ */
+{
+  if ((index->size + 1) * INDEX_MAX_LOAD_DEN
+      > index->capacity * INDEX_MAX_LOAD_NUM && !index_grow (index))
+  {
+    return false;
+  }
+  index_put (index, node, hash);
+  return true;
+}
+
+static DatabaseIndex *get_index (MarkovChain *markov_chain)
+/**
+ * Get the index of the chain's database, building it from the database if
+ * it does not exist yet.
+ * @return the index, NULL if the chain has no hash_func or in case of
+ * allocation error (callers then fall back to a linear search)
+ */
+{
+  if (markov_chain->hash_func == NULL || markov_chain->index != NULL)
+  {
+    return markov_chain->index;
+  }
+  int capacity = INDEX_INITIAL_CAPACITY;
+  while (markov_chain->database->size * INDEX_MAX_LOAD_DEN
+         > capacity * INDEX_MAX_LOAD_NUM)
+  {
+    capacity *= 2;
+  }
+  DatabaseIndex *index = new_index (capacity);
+  if (index == NULL)
+  {
+    return NULL;
+  }
+  for (Node *node = markov_chain->database->first; node; node = node->next)
+  {
+    index_put (index, node, markov_chain->hash_func (node->data->data));
+  }
+  markov_chain->index = index;
+  return index;
+}
+
+static Node *index_lookup (MarkovChain *markov_chain, DatabaseIndex *index,
+                           void *data_ptr, unsigned long hash)
+/**
+ * Find the node wrapping data_ptr using the index.
+ * @return the node, NULL if data_ptr is not in the database
+ */
+{
+  unsigned long mask = (unsigned long) index->capacity - 1;
+  for (unsigned long slot = hash & mask; index->slots[slot] != NULL;
+       slot = (slot + 1) & mask)
+  {
+    if (index->hashes[slot] != hash)
+    {
+      continue;
+    }
+    STATS_ADD (lookup_comparisons, 1);
+    if (markov_chain->comp_func (index->slots[slot]->data->data,
+                                 data_ptr) == 0)
+    {
+      return index->slots[slot];
+    }
+  }
+  return NULL;
+}
+
 MarkovNode *get_first_random_node (MarkovChain *markov_chain)
 /**
  * Get one random state from the given markov_chain's database.
@@ -20,26 +240,124 @@ MarkovNode *get_first_random_node (MarkovChain *markov_chain)
  * @return
  */
 {
+  return get_first_random_node_r (markov_chain, NULL);
+}
+
+static bool refresh_start_nodes (MarkovChain *markov_chain)
+/**
+ * Rebuild the chain's start nodes, if training left them behind.
+ * @return true on success, false in case of allocation error
+ */
+{
+  if (markov_chain->len_start_nodes == markov_chain->num_start_nodes)
+  {
+    return true;
+  }
+  if (markov_chain->cap_start_nodes < markov_chain->num_start_nodes)
+  {
+    MarkovNode **start_nodes = realloc
+        (markov_chain->start_nodes,
+         markov_chain->num_start_nodes * sizeof (MarkovNode *));
+    if (start_nodes == NULL)
+    {
+      return false;
+    }
+    markov_chain->start_nodes = start_nodes;
+    markov_chain->cap_start_nodes = markov_chain->num_start_nodes;
+  }
+  int len = 0;
+  for (int i = 0; i < markov_chain->database->size; i++)
+  {
+    if (markov_chain->nodes[i]->len_counter_list > 0)
+    {
+      markov_chain->start_nodes[len++] = markov_chain->nodes[i];
+    }
+  }
+  markov_chain->len_start_nodes = len;
+  return true;
+}
+
+MarkovNode *get_first_random_node_r (MarkovChain *markov_chain,
+                                     RandomStream *stream)
+{
+  if (markov_chain->num_start_nodes == 0)
+  {
+    return NULL; // drawing would never end
+  }
+  if (stream != NULL)
+  {
+    if (!refresh_start_nodes (markov_chain))
+    {
+      printf (ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+    return markov_chain->start_nodes[get_random_number_r
+        (markov_chain->num_start_nodes, stream)];
+  }
   while (true)
   {
-    int k = get_random_number (markov_chain->database->size);
-    Node *node = markov_chain->database->first;
-    for (int i = 0; i < k; i++)
+    int k = get_random_number_r (markov_chain->database->size, stream);
+    MarkovNode *node = markov_chain->nodes[k];
+    if (node->len_counter_list != 0)
     {
-      Node *next = node->next;
-      node = next;
+      return node;
     }
-    if (node->data->len_counter_list != 0)
+  }
+}
+
+static void append_start_node (MarkovChain *markov_chain,
+                               MarkovNode *markov_node)
+/**
+ * Append the state, that just got its first next state, to the chain's
+ * start nodes if they are up to date and stay in id order (and have room);
+ * otherwise leave them behind, for the next draw to rebuild.
+ */
+{
+  int len = markov_chain->len_start_nodes;
+  if (len != markov_chain->num_start_nodes - 1
+      || (len > 0 && markov_chain->start_nodes[len - 1]->id > markov_node->id))
+  {
+    return;
+  }
+  if (len == markov_chain->cap_start_nodes)
+  {
+    int capacity = len ? len * 2 : INDEX_INITIAL_CAPACITY;
+    STATS_ADD (allocations, 1);
+    STATS_ADD (allocated_bytes, capacity * sizeof (MarkovNode *));
+    MarkovNode **start_nodes = realloc (markov_chain->start_nodes,
+                                        capacity * sizeof (MarkovNode *));
+    if (start_nodes == NULL)
     {
-      return node->data;
+      return;
     }
+    markov_chain->start_nodes = start_nodes;
+    markov_chain->cap_start_nodes = capacity;
+  }
+  markov_chain->start_nodes[len] = markov_node;
+  markov_chain->len_start_nodes++;
+}
+
+static void refresh_prefix_frequency (MarkovNode *markov_node)
+/**
+ * Recompute the invalidated tail of markov_node's prefix sums.
+ */
+{
+  int *prefix = markov_node->prefix_frequency;
+  int i = markov_node->len_prefix_valid;
+  int sum = i > 0 ? prefix[i - 1] : 0;
+  for (; i < markov_node->len_counter_list; i++)
+  {
+    sum += markov_node->counter_list[i].frequency;
+    prefix[i] = sum;
   }
+  markov_node->len_prefix_valid = markov_node->len_counter_list;
 }
 
 MarkovNode *node_by_frequency (MarkovNode *markov_node, int random_frequency,
                                int total_frequencies)
 /**
- * Get the next markov_node by frequency.
+ * Get the next markov_node by frequency: the first successor whose prefix
+ * sum of frequencies exceeds random_frequency (binary search).
  * @param markov_node the current markov_node
  * @param random_frequency the random frequency to get the next markov_node by
  * @param total_frequencies the total frequencies of the current markov_node
@@ -51,13 +369,22 @@ MarkovNode *node_by_frequency (MarkovNode *markov_node, int random_frequency,
   {
     return NULL;
   }
-  int node_ind = 0;
-  while (random_frequency >= markov_node->counter_list[node_ind]->frequency)
+  refresh_prefix_frequency (markov_node);
+  const int *prefix = markov_node->prefix_frequency;
+  int low = 0, high = markov_node->len_counter_list - 1;
+  while (low < high)
   {
-    random_frequency -= markov_node->counter_list[node_ind]->frequency;
-    node_ind++;
+    int mid = low + (high - low) / 2;
+    if (prefix[mid] > random_frequency)
+    {
+      high = mid;
+    }
+    else
+    {
+      low = mid + 1;
+    }
   }
-  return markov_node->counter_list[node_ind]->markov_node;
+  return markov_node->counter_list[low].markov_node;
 }
 
 MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr)
@@ -67,12 +394,27 @@ MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr)
  * @return MarkovNode of the chosen state
  */
 {
-  int total_frequencies = 0;
-  for (int i = 0; i < state_struct_ptr->len_counter_list; i++)
+  return get_next_random_node_r (state_struct_ptr, NULL);
+}
+
+MarkovNode *get_next_random_node_r (MarkovNode *state_struct_ptr,
+                                    RandomStream *stream)
+{
+  STATS_ADD (samples, 1);
+  if (state_struct_ptr->alias_table)
   {
-    total_frequencies += state_struct_ptr->counter_list[i]->frequency;
+    int column = get_random_number_r (state_struct_ptr->len_counter_list,
+                                      stream);
+    AliasEntry entry = state_struct_ptr->alias_table[column];
+    if (get_random_number_r (state_struct_ptr->total_frequency, stream)
+        >= entry.threshold)
+    {
+      column = entry.alias;
+    }
+    return state_struct_ptr->counter_list[column].markov_node;
   }
-  int random_frequency = get_random_number (total_frequencies);
+  int total_frequencies = state_struct_ptr->total_frequency;
+  int random_frequency = get_random_number_r (total_frequencies, stream);
   MarkovNode *node =
       node_by_frequency (state_struct_ptr, random_frequency, total_frequencies);
   return node;
@@ -88,38 +430,421 @@ first_node, int max_length)
  * @param  max_length maximum length of chain to generate
  */
 {
-  MarkovNode *cur_node = (first_node == NULL) ? get_first_random_node
-      (markov_chain) : first_node->data;
-  for (int i = 0; i < max_length; i++)
+  generate_random_sequence_r (markov_chain, first_node, max_length, NULL);
+}
+
+int generate_random_walk (MarkovChain *markov_chain, MarkovNode *first_node,
+                          int max_length, int *ids, void **data,
+                          RandomStream *stream)
+{
+  MarkovNode *cur_node = (first_node == NULL) ? get_first_random_node_r
+      (markov_chain, stream) : first_node;
+  int length = 0;
+  while (length < max_length && cur_node)
   {
-    markov_chain->print_func (cur_node->data);
+    if (ids)
+    {
+      ids[length] = cur_node->id;
+    }
+    if (data)
+    {
+      data[length] = cur_node->data;
+    }
+    length++;
     if (cur_node->len_counter_list == 0)
     {
       break;
     }
-    cur_node = get_next_random_node (cur_node);
+    // drawn even after the last state, so every sequence takes the same
+    // random numbers whatever is done with it
+    cur_node = get_next_random_node_r (cur_node, stream);
+  }
+  return length;
+}
+
+void generate_random_sequences (MarkovChain *markov_chain, int num_sequences,
+                                int max_length, int *ids, void **data,
+                                int *lengths, RandomStream *stream)
+{
+  for (int i = 0; i < num_sequences; i++)
+  {
+    size_t offset = (size_t) i * max_length;
+    lengths[i] = generate_random_walk (markov_chain, NULL, max_length,
+                                       ids ? ids + offset : NULL,
+                                       data ? data + offset : NULL, stream);
   }
-  printf (NEW_LINE);
 }
 
+void generate_random_sequence_r (MarkovChain *markov_chain,
+                                 MarkovNode *first_node, int max_length,
+                                 RandomStream *stream)
+{
+  output_random_sequence (markov_chain, first_node, max_length, stream,
+                          markov_chain->print_func, markov_chain->write_func);
+}
+
+static void build_alias_table (MarkovNode *markov_node, AliasEntry *table,
+                               long long *mass, int *small, int *large)
+/**
+ * Build the alias table of markov_node with Vose's method, in integers:
+ * each of the n columns holds a mass of total_frequency, successor i brings
+ * a mass of n * frequency_i, so every probability is represented exactly.
+ * @param table output, len_counter_list entries
+ * @param mass, small, large workspace of len_counter_list entries each
+ */
+{
+  int n = markov_node->len_counter_list;
+  long long total = markov_node->total_frequency;
+  int n_small = 0, n_large = 0;
+  for (int i = 0; i < n; i++)
+  {
+    mass[i] = (long long) markov_node->counter_list[i].frequency * n;
+    if (mass[i] < total)
+    {
+      small[n_small++] = i;
+    }
+    else
+    {
+      large[n_large++] = i;
+    }
+  }
+  while (n_small > 0 && n_large > 0)
+  {
+    int less = small[--n_small];
+    int more = large[--n_large];
+    table[less] = (AliasEntry) {(int) mass[less], more};
+    mass[more] -= total - mass[less];
+    if (mass[more] < total)
+    {
+      small[n_small++] = more;
+    }
+    else
+    {
+      large[n_large++] = more;
+    }
+  }
+  while (n_large > 0)
+  {
+    int full = large[--n_large];
+    table[full] = (AliasEntry) {(int) total, full};
+  }
+  while (n_small > 0) // unreachable while the masses are exact integers
+  {
+    int full = small[--n_small];
+    table[full] = (AliasEntry) {(int) total, full};
+  }
+}
+
+bool freeze_markov_chain (MarkovChain *markov_chain)
+{
+  int max_len = 1;
+  for (Node *node = markov_chain->database->first; node; node = node->next)
+  {
+    if (node->data->len_counter_list > max_len)
+    {
+      max_len = node->data->len_counter_list;
+    }
+  }
+  long long *mass = malloc (max_len * sizeof (long long));
+  int *small = malloc (max_len * sizeof (int));
+  int *large = malloc (max_len * sizeof (int));
+  bool success = mass && small && large;
+  for (Node *node = markov_chain->database->first; node && success;
+       node = node->next)
+  {
+    MarkovNode *markov_node = node->data;
+    if (markov_node->len_counter_list == 0 || markov_node->alias_table)
+    {
+      continue;
+    }
+    AliasEntry *table = node_alloc
+        (markov_chain, markov_node->len_counter_list * sizeof (AliasEntry));
+    if (table == NULL)
+    {
+      success = false;
+      break;
+    }
+    build_alias_table (markov_node, table, mass, small, large);
+    markov_node->alias_table = table;
+  }
+  free (mass);
+  free (small);
+  free (large);
+  return success;
+}
+
+bool save_markov_chain (const MarkovChain *markov_chain, const char *path)
+{
+  FILE *fp = fopen (path, "wb");
+  if (fp == NULL)
+  {
+    return false;
+  }
+  int num_nodes = markov_chain->database->size;
+  int num_edges = 0;
+  for (int i = 0; i < num_nodes; i++)
+  {
+    num_edges += markov_chain->nodes[i]->len_counter_list;
+  }
+  int header[] = {MODEL_VERSION, num_nodes, num_edges};
+  bool success = fwrite (MODEL_MAGIC, MODEL_MAGIC_LEN, 1, fp) == 1
+                 && fwrite (header, sizeof (header), 1, fp) == 1;
+  for (int i = 0; i < num_nodes && success; i++)
+  {
+    void *data = markov_chain->nodes[i]->data;
+    size_t size = markov_chain->data_size (data);
+    success = fwrite (&size, sizeof (size), 1, fp) == 1
+              && fwrite (data, 1, size, fp) == size;
+  }
+  for (int i = 0; i < num_nodes && success; i++)
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    int len = markov_node->len_counter_list;
+    success = fwrite (&len, sizeof (len), 1, fp) == 1;
+    for (int j = 0; j < len && success; j++)
+    {
+      int edge[] = {markov_node->counter_list[j].markov_node->id,
+                    markov_node->counter_list[j].frequency};
+      success = fwrite (edge, sizeof (edge), 1, fp) == 1;
+    }
+  }
+  return (fclose (fp) == 0) && success;
+}
+
+static bool read_model (const char **cur, const char *end, void *out,
+                        size_t size)
+/**
+ * Read size bytes of the model at *cur to out and advance *cur.
+ * @return true on success, false if the model ends before
+ */
+{
+  if ((size_t) (end - *cur) < size)
+  {
+    return false;
+  }
+  memcpy (out, *cur, size);
+  *cur += size;
+  return true;
+}
+
+static bool load_counter_list (MarkovChain *markov_chain,
+                               MarkovNode *markov_node, const char **cur,
+                               const char *end)
+/**
+ * Read a counter list of the model at *cur to markov_node. The saved list
+ * has no duplicates, so it's copied as is.
+ * @return true on success, false if the list is not valid (including a
+ * total frequency above INT_MAX) or in case of allocation error
+ */
+{
+  int len;
+  if (!read_model (cur, end, &len, sizeof (len)) || len < 0
+      || (size_t) (end - *cur) / (2 * sizeof (int)) < (size_t) len)
+  {
+    return false;
+  }
+  if (len == 0)
+  {
+    return true;
+  }
+  markov_node->counter_list = node_alloc (markov_chain,
+                                          len * sizeof (NextNodeCounter));
+  markov_node->prefix_frequency = node_alloc (markov_chain,
+                                              len * sizeof (int));
+  if (!markov_node->counter_list || !markov_node->prefix_frequency)
+  {
+    return false; // freed with the chain
+  }
+  markov_node->cap_counter_list = len;
+  for (int j = 0; j < len; j++)
+  {
+    int edge[2];
+    read_model (cur, end, edge, sizeof (edge));
+    if (edge[0] < 0 || edge[0] >= markov_chain->database->size
+        || edge[1] <= 0 || edge[1] > INT_MAX - markov_node->total_frequency)
+    {
+      return false;
+    }
+    markov_node->counter_list[j] =
+        (NextNodeCounter) {markov_chain->nodes[edge[0]], edge[1]};
+    markov_node->total_frequency += edge[1];
+    markov_node->prefix_frequency[j] = markov_node->total_frequency;
+    markov_node->len_counter_list++;
+  }
+  markov_node->len_prefix_valid = len;
+  markov_chain->num_start_nodes++;
+  append_start_node (markov_chain, markov_node);
+  return true;
+}
+
+static bool load_model (MarkovChain *markov_chain, const char *model,
+                        const char *end)
+/**
+ * Load the model in [model, end) into the empty markov_chain.
+ * @return true on success, false if the model is not valid (including a
+ * number of transitions other than the header's) or in case of allocation
+ * error
+ */
+{
+  const char *cur = model;
+  char magic[MODEL_MAGIC_LEN];
+  int header[3];
+  if (!read_model (&cur, end, magic, MODEL_MAGIC_LEN)
+      || memcmp (magic, MODEL_MAGIC, MODEL_MAGIC_LEN) != 0
+      || !read_model (&cur, end, header, sizeof (header))
+      || header[0] != MODEL_VERSION || header[1] < 0 || header[2] < 0)
+  {
+    return false;
+  }
+  char *data = NULL; // aligned and NUL terminated copy of the saved data
+  size_t cap_data = 0;
+  for (int i = 0; i < header[1]; i++)
+  {
+    size_t size;
+    if (!read_model (&cur, end, &size, sizeof (size))
+        || (size_t) (end - cur) < size)
+    {
+      free (data);
+      return false;
+    }
+    if (size >= cap_data)
+    {
+      cap_data = size + 1;
+      free (data);
+      data = malloc (cap_data);
+      if (data == NULL)
+      {
+        return false;
+      }
+    }
+    read_model (&cur, end, data, size);
+    data[size] = 0;
+    int db_size = markov_chain->database->size;
+    Node *node = add_to_database (markov_chain, data);
+    if (node == NULL || markov_chain->database->size == db_size)
+    {
+      free (data);
+      return false; // allocation error or duplicate state
+    }
+  }
+  free (data);
+  long num_edges = 0;
+  for (int i = 0; i < header[1]; i++)
+  {
+    if (!load_counter_list (markov_chain, markov_chain->nodes[i], &cur, end))
+    {
+      return false;
+    }
+    num_edges += markov_chain->nodes[i]->len_counter_list;
+  }
+  return cur == end && num_edges == header[2];
+}
+
+bool load_markov_chain (MarkovChain *markov_chain, const char *path)
+{
+  FILE *fp = fopen (path, "rb");
+  if (fp == NULL)
+  {
+    return false;
+  }
+  bool success = fseek (fp, 0, SEEK_END) == 0;
+  long size = success ? ftell (fp) : -1;
+  char *model = size > 0 ? malloc (size) : NULL;
+  success = model != NULL && fseek (fp, 0, SEEK_SET) == 0
+            && fread (model, 1, size, fp) == (size_t) size;
+  fclose (fp);
+  success = success && load_model (markov_chain, model, model + size);
+  free (model);
+  return success;
+}
+
+bool use_node_arena (MarkovChain *markov_chain)
+{
+  if (markov_chain->database->size > 0)
+  {
+    return false;
+  }
+  if (markov_chain->node_arena == NULL)
+  {
+    markov_chain->node_arena = new_arena (NODE_ARENA_BLOCK_SIZE);
+  }
+  return markov_chain->node_arena != NULL;
+}
+
+size_t markov_chain_memory (const MarkovChain *markov_chain)
+{
+  size_t bytes = sizeof (MarkovChain) + sizeof (LinkedList)
+                 + (markov_chain->cap_nodes + markov_chain->cap_start_nodes)
+                   * sizeof (MarkovNode *);
+  if (markov_chain->node_arena)
+  {
+    bytes += sizeof (Arena) + markov_chain->node_arena->bytes_used;
+  }
+  for (int i = 0; i < markov_chain->database->size; i++)
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    if (markov_chain->node_arena == NULL)
+    {
+      bytes += sizeof (Node) + sizeof (MarkovNode)
+               + markov_node->cap_counter_list
+                 * (sizeof (NextNodeCounter) + sizeof (int));
+      if (markov_node->alias_table)
+      {
+        bytes += markov_node->len_counter_list * sizeof (AliasEntry);
+      }
+    }
+    if (markov_chain->data_arena == NULL && markov_chain->data_size)
+    {
+      bytes += markov_chain->data_size (markov_node->data);
+    }
+  }
+  if (markov_chain->index)
+  {
+    bytes += sizeof (DatabaseIndex) + markov_chain->index->capacity
+                                      * (sizeof (Node *)
+                                         + sizeof (unsigned long));
+  }
+  if (markov_chain->data_arena)
+  {
+    bytes += sizeof (Arena) + markov_chain->data_arena->bytes_used;
+  }
+  return bytes;
+}
 
 void free_markov_chain (MarkovChain **markov_chain)
 {
+  bool node_arena = (*markov_chain)->node_arena != NULL;
+  bool data_arena = (*markov_chain)->data_arena != NULL;
   Node *node = (*markov_chain)->database->first;
-  for (int i = 0; i < (*markov_chain)->database->size; i++)
+  for (int i = 0; i < (*markov_chain)->database->size
+                  && !(node_arena && data_arena); i++)
   {
     Node *temp = node->next;
-    for (int j = 0; j < node->data->len_counter_list; j++)
+    if (!data_arena)
     {
-      free (node->data->counter_list[j]);
+      (*markov_chain)->free_data (node->data->data);
+    }
+    if (!node_arena)
+    {
+      free (node->data->counter_list);
+      free (node->data->prefix_frequency);
+      free (node->data->alias_table);
+      free (node->data);
+      free (node);
     }
-    free (node->data->counter_list);
-    free (node->data->data);
-    (*markov_chain)->free_data (node->data);
-    free (node);
     node = temp;
   }
   (*markov_chain)->database->first = NULL;
+  free_arena ((*markov_chain)->node_arena);
+  (*markov_chain)->node_arena = NULL;
+  free_index ((*markov_chain)->index);
+  (*markov_chain)->index = NULL;
+  free_arena ((*markov_chain)->data_arena);
+  (*markov_chain)->data_arena = NULL;
+  free ((*markov_chain)->nodes);
+  (*markov_chain)->nodes = NULL;
+  free ((*markov_chain)->start_nodes);
+  (*markov_chain)->start_nodes = NULL;
 
   free ((*markov_chain)->database);
   (*markov_chain)->database = NULL;
@@ -127,6 +852,73 @@ void free_markov_chain (MarkovChain **markov_chain)
   *markov_chain = NULL;
 }
 
+static bool add_to_counter_list (MarkovNode *first_node, MarkovNode
+*second_node, MarkovChain *markov_chain, int frequency)
+/**
+ * Add the second markov_node to the counter list of the first markov_node
+ * with the given frequency. If already in list, add to it's counter value.
+ * @return true if the process was successful, false in case of
+ * allocation error.
+ */
+{
+  node_free (markov_chain, first_node->alias_table); // the frequencies change
+  first_node->alias_table = NULL;
+  STATS_ADD (successor_scans, 1);
+  for (int i = 0; i < first_node->len_counter_list; i++)
+  {
+    STATS_ADD (successor_comparisons, 1);
+    // interned: equal data is the same state
+    if (first_node->counter_list[i].markov_node == second_node)
+    {
+      first_node->counter_list[i].frequency += frequency;
+      first_node->total_frequency += frequency;
+      if (i < first_node->len_prefix_valid)
+      {
+        first_node->len_prefix_valid = i; // prefix sums from i on are stale
+      }
+      return true;
+    }
+  }
+  if (first_node->len_counter_list == first_node->cap_counter_list)
+  {
+    int capacity = first_node->cap_counter_list
+                   ? first_node->cap_counter_list * 2
+                   : COUNTER_LIST_INITIAL_CAPACITY;
+    size_t len = first_node->len_counter_list;
+    NextNodeCounter *counter_list = node_realloc
+        (markov_chain, first_node->counter_list,
+         len * sizeof (NextNodeCounter), capacity * sizeof (NextNodeCounter));
+    if (counter_list == NULL)
+    {
+      return false;
+    }
+    first_node->counter_list = counter_list;
+    int *prefix = node_realloc (markov_chain, first_node->prefix_frequency,
+                                len * sizeof (int), capacity * sizeof (int));
+    if (prefix == NULL)
+    {
+      return false;
+    }
+    first_node->prefix_frequency = prefix;
+    first_node->cap_counter_list = capacity;
+  }
+  int len = first_node->len_counter_list;
+  if (len == 0)
+  {
+    markov_chain->num_start_nodes++;
+    append_start_node (markov_chain, first_node);
+  }
+  first_node->counter_list[len] = (NextNodeCounter) {second_node, frequency};
+  first_node->total_frequency += frequency;
+  if (first_node->len_prefix_valid == len) // append keeps the sums valid
+  {
+    first_node->prefix_frequency[len] = first_node->total_frequency;
+    first_node->len_prefix_valid++;
+  }
+  first_node->len_counter_list++;
+  return true;
+}
+
 bool add_node_to_counter_list (MarkovNode *first_node, MarkovNode
 *second_node, MarkovChain *markov_chain)
 /**
@@ -139,35 +931,364 @@ bool add_node_to_counter_list (MarkovNode *first_node, MarkovNode
  * allocation error.
  */
 {
-  for (int i = 0; i < first_node->len_counter_list; i++)
+  return add_to_counter_list (first_node, second_node, markov_chain, 1);
+}
+
+bool merge_markov_chain (MarkovChain *target, const MarkovChain *source)
+{
+  int size = source->database->size;
+  MarkovNode **target_nodes = malloc ((size > 0 ? size : 1)
+                                      * sizeof (MarkovNode *));
+  if (target_nodes == NULL)
   {
-    if (markov_chain->comp_func (second_node->data, first_node->
-        counter_list[i]->markov_node->data) == 0)
+    return false;
+  }
+  bool success = true;
+  for (int i = 0; i < size && success; i++)
+  {
+    Node *node = add_to_database (target, source->nodes[i]->data);
+    success = node != NULL;
+    target_nodes[i] = success ? node->data : NULL;
+  }
+  for (int i = 0; i < size && success; i++)
+  {
+    const MarkovNode *markov_node = source->nodes[i];
+    for (int j = 0; j < markov_node->len_counter_list && success; j++)
     {
-      first_node->counter_list[i]->frequency++;
-      return true;
+      const NextNodeCounter *counter = &markov_node->counter_list[j];
+      success = add_to_counter_list
+          (target_nodes[i], target_nodes[counter->markov_node->id], target,
+           counter->frequency);
+    }
+  }
+  free (target_nodes);
+  return success;
+}
+
+static int heaviest_kept_edge (const MarkovNode *markov_node,
+                               const int *new_ids)
+/**
+ * @return the index in the counter list of the state's most frequent
+ * successor that is not pruned (see prune_markov_chain), -1 if there is none
+ */
+{
+  int heaviest = -1;
+  for (int j = 0; j < markov_node->len_counter_list; j++)
+  {
+    const NextNodeCounter *counter = &markov_node->counter_list[j];
+    if (new_ids[counter->markov_node->id] != PRUNED
+        && (heaviest < 0 || counter->frequency
+                            > markov_node->counter_list[heaviest].frequency))
+    {
+      heaviest = j;
     }
   }
-  first_node->counter_list = realloc
-      ((first_node->counter_list), (sizeof (NextNodeCounter *) *
-                                    first_node->len_counter_list)
-                                   + 1 * sizeof (NextNodeCounter *));
-  if (first_node->counter_list == NULL)
+  return heaviest;
+}
+
+static bool keep_edge (const MarkovNode *markov_node, int j,
+                       const int *new_ids, int heaviest, int min_edge_count,
+                       double min_edge_probability)
+/**
+ * Check if prune_markov_chain keeps the j-th transition of the state.
+ * @param heaviest see heaviest_kept_edge
+ */
+{
+  const NextNodeCounter *counter = &markov_node->counter_list[j];
+  if (new_ids[counter->markov_node->id] == PRUNED)
   {
     return false;
   }
-  NextNodeCounter *next_node = malloc (sizeof (NextNodeCounter));
-  *next_node = (NextNodeCounter) {second_node, 1};
-  first_node->counter_list[first_node->len_counter_list] = next_node;
-  first_node->len_counter_list++;
+  double min_frequency = min_edge_probability * markov_node->total_frequency;
+  return j == heaviest || (counter->frequency >= min_edge_count
+                           && counter->frequency >= min_frequency);
+}
+
+static Node *repack_state (MarkovChain *markov_chain,
+                           const MarkovNode *markov_node, int id, int len,
+                           Arena *old_data_arena)
+/**
+ * Allocate the repacked copy of the state (see prune_markov_chain), with
+ * room for len successors, and it's database Node. The data is copied to
+ * the chain's data arena if the old data was in old_data_arena, and is
+ * shared otherwise. The counter list is filled by the caller.
+ * @return the copy, NULL in case of allocation error
+ */
+{
+  MarkovNode *copy = node_alloc (markov_chain, sizeof (MarkovNode));
+  Node *node = node_alloc (markov_chain, sizeof (Node));
+  void *data = old_data_arena ? markov_chain->arena_copy_func
+      (markov_node->data, markov_chain->data_arena) : markov_node->data;
+  size_t list_size = (len > 0 ? len : 1) * sizeof (NextNodeCounter);
+  NextNodeCounter *counter_list = node_alloc (markov_chain, list_size);
+  int *prefix = node_alloc (markov_chain, (len > 0 ? len : 1) * sizeof (int));
+  if (copy == NULL || node == NULL || data == NULL || counter_list == NULL
+      || prefix == NULL)
+  {
+    node_free (markov_chain, copy);
+    node_free (markov_chain, node);
+    node_free (markov_chain, counter_list);
+    node_free (markov_chain, prefix);
+    return NULL;
+  }
+  *copy = (MarkovNode) {data, id, markov_node->is_last, counter_list, 0, len,
+                        0, prefix, 0, NULL};
+  *node = (Node) {copy, NULL};
+  return node;
+}
+
+static void free_repacked (MarkovChain *markov_chain, Node **nodes, int len)
+/**
+ * Free the states allocated by repack_state (nothing to do in an arena).
+ */
+{
+  for (int i = 0; i < len && markov_chain->node_arena == NULL; i++)
+  {
+    if (nodes[i] != NULL)
+    {
+      free (nodes[i]->data->counter_list);
+      free (nodes[i]->data->prefix_frequency);
+      free (nodes[i]->data);
+      free (nodes[i]);
+    }
+  }
+}
+
+static void free_pruned (MarkovChain *markov_chain, const int *new_ids,
+                         Arena *old_node_arena, Arena *old_data_arena)
+/**
+ * Free the states of the chain that prune_markov_chain replaced (all of
+ * them, with the data of the dropped ones), and their arenas.
+ */
+{
+  Node *node = markov_chain->database->first;
+  for (int i = 0; i < markov_chain->database->size; i++)
+  {
+    Node *temp = node->next;
+    if (old_data_arena == NULL && new_ids[i] == PRUNED)
+    {
+      markov_chain->free_data (node->data->data);
+    }
+    if (old_node_arena == NULL)
+    {
+      free (node->data->counter_list);
+      free (node->data->prefix_frequency);
+      free (node->data->alias_table);
+      free (node->data);
+      free (node);
+    }
+    node = temp;
+  }
+  free_arena (old_node_arena);
+  free_arena (old_data_arena);
+}
+
+static int mark_survivors (const MarkovChain *markov_chain, int *new_ids,
+                           int *heaviest, long long *seen,
+                           int min_state_count, int min_edge_count,
+                           double min_edge_probability, PruneReport *report)
+/**
+ * Decide which states and transitions prune_markov_chain keeps: new_ids[i]
+ * is set to the new id of state i, or PRUNED, and heaviest[i] to it's
+ * heaviest_kept_edge. Fills the report but for the bytes after.
+ * @param seen scratch, one entry per state
+ * @return the number of states kept
+ */
+{
+  int size = markov_chain->database->size;
+  long long total_mass = 0, kept_mass = 0;
+  for (int i = 0; i < size; i++)
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    for (int j = 0; j < markov_node->len_counter_list; j++)
+    {
+      seen[markov_node->counter_list[j].markov_node->id] +=
+          markov_node->counter_list[j].frequency;
+    }
+    report->edges_before += markov_node->len_counter_list;
+    total_mass += markov_node->total_frequency;
+  }
+  for (int i = 0; i < size; i++)
+  {
+    long long count = markov_chain->nodes[i]->total_frequency > seen[i]
+                      ? markov_chain->nodes[i]->total_frequency : seen[i];
+    new_ids[i] = count >= min_state_count ? 0 : PRUNED;
+    seen[i] = 0;
+  }
+  for (int i = 0; i < size; i++) // seen[i]: a kept transition leads to i
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    heaviest[i] = new_ids[i] == PRUNED ? -1
+                                       : heaviest_kept_edge (markov_node,
+                                                             new_ids);
+    long long mass = 0;
+    for (int j = 0; heaviest[i] >= 0 && j < markov_node->len_counter_list;
+         j++)
+    {
+      if (keep_edge (markov_node, j, new_ids, heaviest[i], min_edge_count,
+                     min_edge_probability))
+      {
+        seen[markov_node->counter_list[j].markov_node->id] = 1;
+        mass += markov_node->counter_list[j].frequency;
+        report->edges_after++;
+      }
+    }
+    kept_mass += mass;
+    // only the states that keep a successor: they survive with all of their
+    // kept transitions, the others are dropped or made terminal (counted in
+    // mass_removed)
+    if (heaviest[i] >= 0)
+    {
+      double deviation = 1 - (double) mass / markov_node->total_frequency;
+      report->max_deviation = deviation > report->max_deviation
+                              ? deviation : report->max_deviation;
+    }
+  }
+  int kept = 0;
+  for (int i = 0; i < size; i++)
+  {
+    new_ids[i] = new_ids[i] != PRUNED && (heaviest[i] >= 0 || seen[i])
+                 ? kept++ : PRUNED;
+  }
+  report->states_after = kept;
+  report->mass_removed = total_mass ? 1 - (double) kept_mass / total_mass : 0;
+  return kept;
+}
+
+bool prune_markov_chain (MarkovChain *markov_chain, int min_state_count,
+                         int min_edge_count, double min_edge_probability,
+                         PruneReport *report)
+{
+  int size = markov_chain->database->size;
+  PruneReport result = {size, 0, 0, 0, markov_chain_memory (markov_chain), 0,
+                        0, 0};
+  int *new_ids = malloc ((size > 0 ? size : 1) * sizeof (int));
+  int *heaviest = malloc ((size > 0 ? size : 1) * sizeof (int));
+  long long *seen = calloc (size > 0 ? size : 1, sizeof (long long));
+  if (new_ids == NULL || heaviest == NULL || seen == NULL)
+  {
+    free (new_ids);
+    free (heaviest);
+    free (seen);
+    return false;
+  }
+  int kept = mark_survivors (markov_chain, new_ids, heaviest, seen,
+                             min_state_count, min_edge_count,
+                             min_edge_probability, &result);
+  Arena *old_node_arena = markov_chain->node_arena;
+  Arena *old_data_arena = markov_chain->data_arena;
+  markov_chain->node_arena = old_node_arena
+                             ? new_arena (NODE_ARENA_BLOCK_SIZE) : NULL;
+  markov_chain->data_arena = old_data_arena
+                             ? new_arena (old_data_arena->block_size) : NULL;
+  Node **repacked = calloc (kept > 0 ? kept : 1, sizeof (Node *));
+  MarkovNode **nodes = malloc ((kept > 0 ? kept : 1) * sizeof (MarkovNode *));
+  bool success = repacked && nodes
+                 && (markov_chain->node_arena || !old_node_arena)
+                 && (markov_chain->data_arena || !old_data_arena);
+  for (int i = 0; i < size && success; i++)
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    int id = new_ids[i];
+    if (id == PRUNED)
+    {
+      continue;
+    }
+    int len = 0;
+    for (int j = 0; heaviest[i] >= 0 && j < markov_node->len_counter_list;
+         j++)
+    {
+      len += keep_edge (markov_node, j, new_ids, heaviest[i], min_edge_count,
+                        min_edge_probability);
+    }
+    repacked[id] = repack_state (markov_chain, markov_node, id, len,
+                                 old_data_arena);
+    success = repacked[id] != NULL;
+    nodes[id] = success ? repacked[id]->data : NULL;
+  }
+  if (!success)
+  {
+    if (repacked)
+    {
+      free_repacked (markov_chain, repacked, kept);
+    }
+    free (repacked);
+    free (nodes);
+    free_arena (markov_chain->node_arena);
+    free_arena (markov_chain->data_arena);
+    markov_chain->node_arena = old_node_arena;
+    markov_chain->data_arena = old_data_arena;
+    free (new_ids);
+    free (heaviest);
+    free (seen);
+    return false;
+  }
+  LinkedList database = {NULL, NULL, 0};
+  int num_start_nodes = 0;
+  for (int i = 0; i < size; i++)
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    if (new_ids[i] == PRUNED)
+    {
+      continue;
+    }
+    MarkovNode *copy = nodes[new_ids[i]];
+    for (int j = 0; heaviest[i] >= 0 && j < markov_node->len_counter_list;
+         j++)
+    {
+      const NextNodeCounter *counter = &markov_node->counter_list[j];
+      if (keep_edge (markov_node, j, new_ids, heaviest[i], min_edge_count,
+                     min_edge_probability))
+      {
+        int len = copy->len_counter_list++;
+        copy->counter_list[len] = (NextNodeCounter)
+            {nodes[new_ids[counter->markov_node->id]], counter->frequency};
+        copy->total_frequency += counter->frequency;
+        copy->prefix_frequency[len] = copy->total_frequency;
+      }
+    }
+    copy->len_prefix_valid = copy->len_counter_list;
+    num_start_nodes += copy->len_counter_list > 0;
+    append_node (&database, repacked[new_ids[i]]);
+  }
+  MarkovNode *last_ingested = markov_chain->last_ingested;
+  markov_chain->last_ingested = last_ingested && new_ids[last_ingested->id]
+                                                 != PRUNED
+                                ? nodes[new_ids[last_ingested->id]] : NULL;
+  free_pruned (markov_chain, new_ids, old_node_arena, old_data_arena);
+  *markov_chain->database = database;
+  free (markov_chain->nodes);
+  markov_chain->nodes = nodes;
+  markov_chain->cap_nodes = kept > 0 ? kept : 1;
+  markov_chain->num_start_nodes = num_start_nodes;
+  markov_chain->len_start_nodes = 0; // rebuilt on the next draw
+  free_index (markov_chain->index); // rebuilt on the next lookup
+  markov_chain->index = NULL;
+  result.bytes_after = markov_chain_memory (markov_chain);
+  if (report)
+  {
+    *report = result;
+  }
+  free (repacked);
+  free (new_ids);
+  free (heaviest);
+  free (seen);
   return true;
 }
 
 Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr)
 {
+  STATS_ADD (lookups, 1);
+  DatabaseIndex *index = get_index (markov_chain);
+  if (index)
+  {
+    return index_lookup (markov_chain, index, data_ptr,
+                         markov_chain->hash_func (data_ptr));
+  }
   Node *temp = markov_chain->database->first;
   for (int i = 0; i < markov_chain->database->size; i++)
   {
+    STATS_ADD (lookup_comparisons, 1);
     if (markov_chain->comp_func (temp->data->data, data_ptr) == 0)
     {
       return temp;
@@ -178,13 +1299,39 @@ Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr)
   return NULL;
 }
 
+static bool reserve_nodes (MarkovChain *markov_chain)
+/**
+ * Make room in the chain's nodes array for one more state.
+ * @return true on success, false in case of allocation error
+ */
+{
+  if (markov_chain->database->size < markov_chain->cap_nodes)
+  {
+    return true;
+  }
+  int capacity = markov_chain->cap_nodes ? markov_chain->cap_nodes * 2
+                                         : INDEX_INITIAL_CAPACITY;
+  STATS_ADD (allocations, 1);
+  STATS_ADD (allocated_bytes, capacity * sizeof (MarkovNode *));
+  MarkovNode **nodes = realloc (markov_chain->nodes,
+                                capacity * sizeof (MarkovNode *));
+  if (nodes == NULL)
+  {
+    return false;
+  }
+  markov_chain->nodes = nodes;
+  markov_chain->cap_nodes = capacity;
+  return true;
+}
+
 Node *add_to_database (MarkovChain *markov_chain, void *data_ptr)
 /**
  * If data_ptr in markov_chain, return it's markov_node. Otherwise, create new
  * markov_node, add to end of markov_chain's database and return it.
  * @param markov_chain the chain to look in its database
  * @param data_ptr the state to look for
- * @return markov_node wrapping given data_ptr in given chain's database
+ * @return markov_node wrapping given data_ptr in given chain's database, NULL
+ * in case of allocation error
  */
 {
   Node *node = get_node_from_database (markov_chain, data_ptr);
@@ -192,10 +1339,48 @@ Node *add_to_database (MarkovChain *markov_chain, void *data_ptr)
   {
     return node;
   }
-  void *data = markov_chain->copy_func (data_ptr);
-  MarkovNode *new_node = malloc (sizeof (MarkovNode));
-  NextNodeCounter **p_next_node = malloc (sizeof (NextNodeCounter *));
-  *new_node = (MarkovNode) {data, p_next_node, EMPTY_LIST};
-  add (markov_chain->database, new_node);
-  return markov_chain->database->last;
+  return add_new_to_database (markov_chain, data_ptr);
+}
+
+Node *add_new_to_database (MarkovChain *markov_chain, void *data_ptr)
+{
+  Node *node;
+  if (!reserve_nodes (markov_chain))
+  {
+    return NULL;
+  }
+  void *data = markov_chain->data_arena
+               ? markov_chain->arena_copy_func (data_ptr,
+                                                markov_chain->data_arena)
+               : markov_chain->copy_func (data_ptr);
+  STATS_ADD (allocations, 1);
+  STATS_ADD (allocated_bytes, markov_chain->data_size
+                              ? markov_chain->data_size (data_ptr) : 0);
+  MarkovNode *new_node = node_alloc (markov_chain, sizeof (MarkovNode));
+  node = node_alloc (markov_chain, sizeof (Node));
+  if (data == NULL || new_node == NULL || node == NULL)
+  {
+    if (data && markov_chain->data_arena == NULL)
+    {
+      markov_chain->free_data (data);
+    }
+    node_free (markov_chain, new_node);
+    node_free (markov_chain, node);
+    return NULL;
+  }
+  *new_node = (MarkovNode) {data, markov_chain->database->size,
+                            markov_chain->is_last (data), NULL, EMPTY_LIST,
+                            EMPTY_LIST, 0, NULL, EMPTY_LIST, NULL};
+  node->data = new_node;
+  append_node (markov_chain->database, node);
+  markov_chain->nodes[markov_chain->database->size - 1] = new_node;
+  if (markov_chain->index && !index_insert
+      (markov_chain->index, node, markov_chain->hash_func (data)))
+  {
+    // keep the database consistent: drop the index, it is rebuilt on the
+    // next lookup
+    free_index (markov_chain->index);
+    markov_chain->index = NULL;
+  }
+  return node;
 }
@@ -2,6 +2,9 @@
 #define _MARKOV_CHAIN_H
 
 #include "linked_list.h"
+#include "arena.h"
+#include "output_sink.h"
+#include "random_stream.h"
 #include <stdio.h>  // For printf(), sscanf()
 #include <stdlib.h> // For exit(), malloc()
 #include <stdbool.h> // for bool
@@ -9,6 +12,11 @@
 #define ALLOCATION_ERROR_MASSAGE \
 "Allocation failure: Failed to allocate new memory\n"
 #define EMPTY_LIST 0
+#define MODEL_MAGIC "MKVC"
+#define MODEL_MAGIC_LEN 4
+#define MODEL_VERSION 1
+// walks up to this length are collected on the stack when printed
+#define MAX_STACK_WALK 64
 
 
 /***************************/
@@ -26,6 +34,16 @@ typedef void *(*copy_f) (void *);
 
 typedef bool (*is_last_f) (void *);
 
+typedef unsigned long (*hash_f) (void *);
+
+typedef void *(*arena_copy_f) (void *, Arena *);
+
+typedef size_t (*data_size_f) (void *);
+
+typedef bool (*valid_data_f) (const void *, size_t);
+
+typedef void (*write_f) (void *, OutputSink *);
+
 /***************************/
 
 
@@ -40,14 +58,70 @@ typedef struct NextNodeCounter
     int frequency;
 } NextNodeCounter;
 
+/**
+ * One column of a (Vose) alias table: draw r in [0, total_frequency), the
+ * column's own successor is chosen if r < threshold, alias otherwise.
+ */
+typedef struct AliasEntry
+{
+    int threshold;
+    int alias; // index in counter_list
+} AliasEntry;
+
 typedef struct MarkovNode
 {
     void *data;
-    NextNodeCounter **counter_list;
+    int id; // index of the state in the chain's nodes array
+    // the chain's is_last of data, cached when the state is interned, so
+    // training doesn't touch the data
+    bool is_last;
+    NextNodeCounter *counter_list; // successors, stored inline
     int len_counter_list;
+    int cap_counter_list; // allocated length of counter_list, grows x2
+    int total_frequency; // sum of the frequencies in counter_list
+    // prefix_frequency[i] is the sum of frequencies 0..i, valid for
+    // i < len_prefix_valid, brought up to date lazily by sampling
+    int *prefix_frequency;
+    int len_prefix_valid;
+    AliasEntry *alias_table; // built by freeze_markov_chain, NULL otherwise
 } MarkovNode;
 
-/* DO NOT ADD or CHANGE variable names in this struct */
+/**
+ * Open-addressing (linear probing) index over the database nodes. Every
+ * slot caches the hash of its node's data, so probing only calls comp_func
+ * on real hash matches and growing never rehashes the data.
+ */
+typedef struct DatabaseIndex
+{
+    Node **slots;
+    unsigned long *hashes;
+    int capacity; // always a power of 2
+    int size;
+} DatabaseIndex;
+
+/**
+ * What prune_markov_chain removed: the size of the chain before and after,
+ * and how much the distribution of the next state changed.
+ */
+typedef struct PruneReport
+{
+    int states_before;
+    int states_after;
+    long edges_before;
+    long edges_after;
+    size_t bytes_before; // see markov_chain_memory
+    size_t bytes_after;
+    // fraction of the transitions seen in training (sum of frequencies)
+    // that were dropped, with the states or their successors
+    double mass_removed;
+    // largest total variation distance between the distribution of the next
+    // state of a kept state that keeps successors, before and after: the
+    // fraction of it's transitions that were dropped (states left without
+    // successors end the sequence instead, see mass_removed)
+    double max_deviation;
+} PruneReport;
+
+/* DO NOT CHANGE variable names in this struct, new fields go at the end */
 typedef struct MarkovChain
 {
     LinkedList *database;
@@ -78,33 +152,237 @@ typedef struct MarkovChain
     //      - true if it's the last state.
     //      - false otherwise.
     /*<fill_type>*/ is_last_f is_last;
+
+    // a pointer to a function that gets a pointer of generic data type and
+    // returns its hash. data that compares equal must hash equally.
+    // optional: if NULL the database is searched linearly with comp_func.
+    hash_f hash_func;
+
+    // hash index over database, built on demand when hash_func is set.
+    DatabaseIndex *index;
+
+    // optional arena owning the copies of the data in the database. when
+    // set, add_to_database copies new data with arena_copy_func (a function
+    // that gets a pointer of generic data type and an arena and returns a
+    // copy allocated from it) instead of copy_func, and free_markov_chain
+    // releases all the copies at once with the arena instead of free_data.
+    Arena *data_arena;
+    arena_copy_f arena_copy_func;
+
+    // the states of database by insertion order, for access by index in
+    // O(1), maintained by add_to_database.
+    MarkovNode **nodes;
+    int cap_nodes;
+
+    // number of states with a non-empty counter list (that can start a
+    // walk), maintained by add_node_to_counter_list.
+    int num_start_nodes;
+
+    // a pointer to a function that gets a pointer of generic data type and
+    // returns the number of bytes it occupies: the data is saved as those
+    // bytes, and loaded by copying them (copy_func or arena_copy_func).
+    // optional: needed only by save_markov_chain.
+    data_size_f data_size;
+
+    // optional output sink: when set, generate_random_sequence writes the
+    // sequences to it with write_func (a function that gets a pointer of
+    // generic data type and a sink, and writes it like print_func prints it)
+    // instead of printing them. the sink is owned by the caller.
+    write_f write_func;
+    OutputSink *sink;
+
+    // the last state added by training, that the next trained state follows
+    // (NULL before training): lets training continue across calls (see
+    // markov_chain_ingest).
+    MarkovNode *last_ingested;
+
+    // optional arena for the states: when set (see use_node_arena), the
+    // database's Nodes, the MarkovNodes and their counter lists, prefix sums
+    // and alias tables are bump allocated from it, and free_markov_chain
+    // releases them all at once with it instead of one by one.
+    Arena *node_arena;
+
+    // the states with a non-empty counter list in id order, so a first
+    // state is drawn from a stream in O(1): add_node_to_counter_list appends
+    // while the order holds (len_start_nodes is then num_start_nodes),
+    // otherwise the next draw rebuilds them.
+    MarkovNode **start_nodes;
+    int len_start_nodes;
+    int cap_start_nodes;
 } MarkovChain;
 
 /**
- * Get one random state from the given markov_chain's database.
+* Get random number between 0 and max_number [0, max_number).
+* @param max_number maximal number to return (not including)
+* @return Random number
+*/
+int get_random_number (int max_number);
+
+/**
+ * Get random number between 0 and max_number [0, max_number), from the given
+ * stream.
+ * @param max_number maximal number to return (not including)
+ * @param stream the stream to draw from, NULL for get_random_number (rand())
+ * @return Random number
+ */
+int get_random_number_r (int max_number, RandomStream *stream);
+
+/**
+ * Get one random state from the given markov_chain's database, that has at
+ * least one next state. O(1) access per draw, draws are repeated until such a
+ * state is drawn.
  * @param markov_chain
- * @return
+ * @return the state, NULL if no state in the database has a next state
  */
 MarkovNode *get_first_random_node (MarkovChain *markov_chain);
 
+/**
+ * get_first_random_node, drawing from the given stream instead of rand().
+ * From a stream, the state is drawn from the chain's start nodes in one draw
+ * (rebuilding them first if training broke their order), so like
+ * get_next_random_node_r it's not thread safe on its own.
+ * @param stream the stream to draw from, NULL for rand()
+ */
+MarkovNode *get_first_random_node_r (MarkovChain *markov_chain,
+                                     RandomStream *stream);
+
 /**
  * Choose randomly the next state, depend on it's occurrence frequency.
+ * O(1) for a frozen state, O(log k) for k successors otherwise (plus the
+ * refresh of prefix sums invalidated by training since the last call).
  * @param state_struct_ptr MarkovNode to choose from
  * @return MarkovNode of the chosen state
  */
 MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr);
 
 /**
- * Receive markov_chain, generate and print random sentence out of it. The
- * sentence most have at least 2 words in it.
+ * get_next_random_node, drawing from the given stream instead of rand().
+ * Not thread safe on its own: sampling an unfrozen state may refresh its
+ * prefix sums (walk a compiled graph from several threads instead).
+ * @param stream the stream to draw from, NULL for rand()
+ */
+MarkovNode *get_next_random_node_r (MarkovNode *state_struct_ptr,
+                                    RandomStream *stream);
+
+/**
+ * Receive markov_chain, generate and print random sentence out of it (to
+ * the chain's sink, if it has one). The sentence most have at least 2 words
+ * in it.
  * @param markov_chain
  * @param first_node markov_node to start with, if NULL- choose a random
- * markov_node
+ * markov_node (if there is none, an empty sentence is generated)
  * @param  max_length maximum length of chain to generate
  */
 void generate_random_sequence (MarkovChain *markov_chain, MarkovNode *
 first_node, int max_length);
 
+/**
+ * generate_random_sequence, drawing from the given stream instead of rand().
+ * With a stream of its own (see seed_random_stream) every sequence is a pure
+ * function of the seed and the stream's index: sequence i can be generated
+ * without generating the ones before it. An unfrozen chain generates what
+ * graph_write_random_sequence generates from its compiled graph.
+ * Prints what generate_random_walk returns.
+ * @param stream the stream to draw from, NULL for rand()
+ */
+void generate_random_sequence_r (MarkovChain *markov_chain,
+                                 MarkovNode *first_node, int max_length,
+                                 RandomStream *stream);
+
+/**
+ * Random walk over the chain, like generate_random_sequence_r without
+ * printing: the states are written to the caller's arrays, with no
+ * allocation or I/O, and the same random numbers are drawn.
+ * @param markov_chain
+ * @param first_node markov_node to start with, if NULL- choose a random
+ * markov_node (if there is none, the walk is empty)
+ * @param max_length maximum length of the walk
+ * @param ids output, the ids of the states (index in the nodes array), at
+ * least max_length entries, may be NULL
+ * @param data output, the data of the states (e.g. the words, as strings),
+ * at least max_length entries, may be NULL
+ * @param stream the stream to draw from, NULL for rand()
+ * @return the length of the walk
+ */
+int generate_random_walk (MarkovChain *markov_chain, MarkovNode *first_node,
+                          int max_length, int *ids, void **data,
+                          RandomStream *stream);
+
+/**
+ * Generate num_sequences random walks (see generate_random_walk) from random
+ * first states, one after the other: walk i is written from entry
+ * i * max_length of ids and data, and its length to lengths[i].
+ * @param ids output, num_sequences * max_length entries, may be NULL
+ * @param data output, num_sequences * max_length entries, may be NULL
+ * @param lengths output, num_sequences entries
+ * @param stream the stream to draw from, NULL for rand()
+ */
+void generate_random_sequences (MarkovChain *markov_chain, int num_sequences,
+                                int max_length, int *ids, void **data,
+                                int *lengths, RandomStream *stream);
+
+/**
+ * Freeze the chain for generation: build an alias table for every state, so
+ * get_next_random_node samples in constant time instead of scanning the
+ * counter list. The output distribution stays the same, but the random
+ * numbers are consumed differently, so a seed generates different output
+ * than before freezing. Adding to a frozen state's counter list drops its
+ * table (the state goes back to the linear sampling).
+ * @param markov_chain the chain to freeze
+ * @return true on success, false in case of allocation error (states left
+ * without a table keep the linear sampling)
+ */
+bool freeze_markov_chain (MarkovChain *markov_chain);
+
+/**
+ * Save the chain's model (states, counter lists and frequencies) to a binary
+ * file, that load_markov_chain loads without retraining. Format (version
+ * MODEL_VERSION, native byte order and int size):
+ *   "MKVC" | version | number of states | number of transitions
+ *   for every state, by id: data size | data bytes
+ *   for every state, by id: length of counter list |
+ *                           (successor id | frequency) * length
+ * @param markov_chain the chain to save, must have a data_size function
+ * @param path path of the file to write
+ * @return true on success, false if the file can't be written
+ */
+bool save_markov_chain (const MarkovChain *markov_chain, const char *path);
+
+/**
+ * Load a model saved by save_markov_chain into an empty chain that has the
+ * callbacks of the saved one. The chain is the same as the saved one
+ * (states and counter lists in the same order), so it generates the same
+ * sequences for the same seed.
+ * @param markov_chain the chain to load into, must be empty
+ * @param path path of the file to read
+ * @return true on success, false if the file can't be read or is not a valid
+ * model, or in case of allocation error
+ */
+bool load_markov_chain (MarkovChain *markov_chain, const char *path);
+
+/**
+ * Allocate the states of the (empty) markov_chain from an arena from now on
+ * (see MarkovChain's node_arena): building the chain takes no malloc per
+ * state or counter list, and freeing it releases a few large blocks. Counter
+ * lists that grow leave their old storage unused in the arena, which at most
+ * doubles their memory.
+ * @param markov_chain the chain, with an empty database
+ * @return true on success, false if the chain is not empty or in case of
+ * allocation error
+ */
+bool use_node_arena (MarkovChain *markov_chain);
+
+/**
+ * Count the bytes the markov_chain takes: its states, their counter lists,
+ * prefix sums and alias tables (the node arena's allocations, if it has
+ * one), the database and the index, and the data (the data arena's
+ * allocations, or data_size of every state's data if the data is not in an
+ * arena and data_size is set). Allocator overhead is not counted.
+ * @param markov_chain
+ * @return the number of bytes
+ */
+size_t markov_chain_memory (const MarkovChain *markov_chain);
+
 /**
  * Free markov_chain and all of it's content from memory
  * @param markov_chain markov_chain to free
@@ -113,7 +391,9 @@ void free_markov_chain (MarkovChain **markov_chain);
 
 /**
  * Add the second markov_node to the counter list of the first markov_node.
- * If already in list, update it's counter value.
+ * If already in list, update it's counter value. States are interned (one
+ * MarkovNode, with one id, per distinct data), so the list is searched by
+ * identity, without comparing the data.
  * @param first_node
  * @param second_node
  * @param markov_chain
@@ -123,10 +403,52 @@ void free_markov_chain (MarkovChain **markov_chain);
 bool add_node_to_counter_list (MarkovNode *first_node, MarkovNode
 *second_node, MarkovChain *markov_chain);
 
+/**
+ * Merge the source chain into the target chain: add the source's states to
+ * the target's database (copied, in the source's order) and add the
+ * source's counter lists to the target's, summing the frequencies of
+ * transitions both chains have. Merging the chains trained on consecutive
+ * parts of a corpus, in order, gives the states and counter lists the order
+ * training on the whole corpus gives them (the transition from the last
+ * state of one part to the first state of the next is not in either chain).
+ * @param target the chain to merge into
+ * @param source the chain to merge, left unchanged
+ * @return true on success, false in case of allocation error
+ */
+bool merge_markov_chain (MarkovChain *target, const MarkovChain *source);
+
+/**
+ * Prune the trained chain and repack it: drop the states seen less than
+ * min_state_count times (as a successor or as a predecessor, whichever is
+ * more), and the transitions to them; drop the transitions seen less than
+ * min_edge_count times or with less than min_edge_probability of their
+ * state's transitions, except the most frequent transition a state keeps, so
+ * pruning transitions never ends a sequence early; then drop the states left
+ * unreachable (no transition to or from them). The surviving states keep
+ * their order and are renumbered 0 to n-1, and are repacked with their data
+ * and counter lists in new storage (new arenas, if the chain has them), so
+ * the memory of the dropped ones is released. Alias tables are dropped:
+ * freeze the chain again to sample in constant time. Graphs compiled before
+ * are not updated.
+ * @param markov_chain the chain to prune
+ * @param min_state_count states seen less times are dropped, 0 to keep all
+ * @param min_edge_count transitions seen less times are dropped, 0 to keep
+ * all
+ * @param min_edge_probability transitions with a smaller probability are
+ * dropped, 0 to keep all
+ * @param report output, what was removed, may be NULL
+ * @return true on success, false in case of allocation error (the chain is
+ * left unchanged)
+ */
+bool prune_markov_chain (MarkovChain *markov_chain, int min_state_count,
+                         int min_edge_count, double min_edge_probability,
+                         PruneReport *report);
+
 /**
 * Check if data_ptr is in database. If so, return the markov_node wrapping
  * it in
- * the markov_chain, otherwise return NULL.
+ * the markov_chain, otherwise return NULL. O(1) expected if the chain has a
+ * hash_func, linear in the database size otherwise.
  * @param markov_chain the chain to look in its database
  * @param data_ptr the state to look for
  * @return Pointer to the Node wrapping given state, NULL if state not in
@@ -139,8 +461,20 @@ Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr);
  * markov_node, add to end of markov_chain's database and return it.
  * @param markov_chain the chain to look in its database
  * @param data_ptr the state to look for
- * @return markov_node wrapping given data_ptr in given chain's database
+ * @return markov_node wrapping given data_ptr in given chain's database, NULL
+ * in case of allocation error
  */
 Node *add_to_database (MarkovChain *markov_chain, void *data_ptr);
 
+/**
+ * Create a new markov_node for data_ptr, that is not in markov_chain's
+ * database (e.g. a lookup just missed it), add it to the end of the database
+ * and return it: add_to_database without the lookup.
+ * @param markov_chain the chain to add to
+ * @param data_ptr the state to add, not in the database
+ * @return markov_node wrapping a copy of data_ptr, NULL in case of
+ * allocation error
+ */
+Node *add_new_to_database (MarkovChain *markov_chain, void *data_ptr);
+
 #endif /* MARKOV_CHAIN_H */
@@ -0,0 +1,137 @@
+#ifndef _MARKOV_CHAIN_TEMPLATE_H
+#define _MARKOV_CHAIN_TEMPLATE_H
+
+#include "markov_chain.h"
+#include "markov_stats.h"
+
+/**
+ * Walk the chain and print the sequence like generate_random_sequence_r
+ * (which is this with the chain's print_func and write_func): print every
+ * state with print_func, or write it with write_func to the chain's sink if
+ * the chain has a write_func. Walks of up to MAX_STACK_WALK states are
+ * collected on the stack. Inlined into the specializations below with their
+ * bound functions, so the calls are direct.
+ */
+static inline void output_random_sequence (MarkovChain *markov_chain,
+                                           MarkovNode *first_node,
+                                           int max_length,
+                                           RandomStream *stream,
+                                           print_f print_func,
+                                           write_f write_func)
+{
+  void *walk[MAX_STACK_WALK];
+  void **data = walk;
+  if (max_length > MAX_STACK_WALK)
+  {
+    data = malloc (max_length * sizeof (void *));
+    if (data == NULL)
+    {
+      printf (ALLOCATION_ERROR_MASSAGE);
+      return;
+    }
+  }
+  int length = generate_random_walk (markov_chain, first_node, max_length,
+                                     NULL, data, stream);
+  OutputSink *sink = markov_chain->write_func ? markov_chain->sink : NULL;
+  for (int i = 0; i < length; i++)
+  {
+    if (sink)
+    {
+      write_func (data[i], sink);
+    }
+    else
+    {
+      print_func (data[i]);
+    }
+  }
+  if (sink)
+  {
+    sink_write_str (sink, NEW_LINE);
+  }
+  else
+  {
+    printf (NEW_LINE);
+  }
+  if (data != walk)
+  {
+    free (data);
+  }
+}
+
+/**
+ * Stamp out a specialization of the chain functions that call the chain's
+ * callbacks in their inner loops, for a chain over data of type TYPE: the
+ * callbacks are bound at compile time to the given functions instead of
+ * being called through the chain's pointers, so the compiler can inline
+ * them. Defines, as static inline functions of the including file:
+ *
+ * - Node *NAME_get_node_from_database (MarkovChain *, TYPE data): like
+ *   get_node_from_database, probing the index with HASH and COMP.
+ * - Node *NAME_add_to_database (MarkovChain *, TYPE data): like
+ *   add_to_database, looking up with NAME_get_node_from_database.
+ * - void NAME_generate_random_sequence (MarkovChain *, MarkovNode *first,
+ *   int max_length, RandomStream *): generate_random_sequence_r (see
+ *   output_random_sequence), printing with PRINT and writing with WRITE.
+ *
+ * The specialized functions work on the same chain as the generic ones
+ * (the generic API stays usable on it, e.g. for the callbacks that are not
+ * bound: copy, free, is_last), so the bound functions must be the chain's
+ * own: HASH its hash_func, COMP its comp_func, PRINT its print_func and
+ * WRITE its write_func. A chain without a hash_func falls back to the
+ * generic lookup.
+ * @param NAME prefix of the generated functions
+ * @param TYPE type of the data, a pointer type
+ * @param HASH unsigned long (void *): hash of the data
+ * @param COMP int (void *, void *): compare two data, 0 if equal
+ * @param PRINT void (void *): print the data, a print_f
+ * @param WRITE void (void *, OutputSink *): write the data to the sink, a
+ * write_f
+ */
+#define MARKOV_CHAIN_TEMPLATE(NAME, TYPE, HASH, COMP, PRINT, WRITE)         \
+static inline Node *NAME##_get_node_from_database (MarkovChain *markov_chain,\
+                                                   TYPE data)                \
+{                                                                            \
+  DatabaseIndex *index = markov_chain->index;                                \
+  if (index == NULL) /* not built yet (or no hash_func) */                   \
+  {                                                                          \
+    return get_node_from_database (markov_chain, data);                      \
+  }                                                                          \
+  STATS_ADD (lookups, 1);                                                    \
+  unsigned long hash = HASH (data);                                          \
+  unsigned long mask = (unsigned long) index->capacity - 1;                  \
+  for (unsigned long slot = hash & mask; index->slots[slot] != NULL;         \
+       slot = (slot + 1) & mask)                                             \
+  {                                                                          \
+    if (index->hashes[slot] != hash)                                         \
+    {                                                                        \
+      continue;                                                              \
+    }                                                                        \
+    STATS_ADD (lookup_comparisons, 1);                                       \
+    if (COMP (index->slots[slot]->data->data, data) == 0)                    \
+    {                                                                        \
+      return index->slots[slot];                                             \
+    }                                                                        \
+  }                                                                          \
+  return NULL;                                                               \
+}                                                                            \
+                                                                             \
+static inline Node *NAME##_add_to_database (MarkovChain *markov_chain,      \
+                                            TYPE data)                       \
+{                                                                            \
+  Node *node = NAME##_get_node_from_database (markov_chain, data);           \
+  if (node)                                                                  \
+  {                                                                          \
+    return node;                                                             \
+  }                                                                          \
+  return add_new_to_database (markov_chain, data);                           \
+}                                                                            \
+                                                                             \
+static inline void NAME##_generate_random_sequence                           \
+    (MarkovChain *markov_chain, MarkovNode *first_node, int max_length,      \
+     RandomStream *stream)                                                   \
+{                                                                            \
+  output_random_sequence (markov_chain, first_node, max_length, stream,      \
+                          PRINT, WRITE);                                     \
+}
+
+#endif /* _MARKOV_CHAIN_TEMPLATE_H */
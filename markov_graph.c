@@ -0,0 +1,727 @@
+#define _POSIX_C_SOURCE 200809L // For mmap(), open()
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "markov_graph.h"
+#include "markov_stats.h"
+
+#define SECTION_ALIGNMENT 8
+#define TMP_SUFFIX ".tmp"
+#define WEIGHTS_BLOCK 16 // quantized edges per block sum
+
+/**
+ * Header of a graph file. Sections are given by their offset in the file.
+ */
+typedef struct GraphFileHeader
+{
+    char magic[GRAPH_MAGIC_LEN];
+    int version;
+    int num_nodes;
+    int num_edges;
+    int num_start_nodes;
+    int reserved; // 0, explicit padding so the file has no undefined bytes
+    long offsets_pos;
+    long successors_pos;
+    long weights_pos;
+    long data_offsets_pos;
+    long data_pos;
+    long file_len;
+} GraphFileHeader;
+
+static void *alloc_array (int length, size_t size)
+/**
+ * Allocate an array of length elements of the given size (at least one, so
+ * empty arrays are not mistaken for allocation errors).
+ */
+{
+  return malloc ((length > 0 ? length : 1) * size);
+}
+
+MarkovGraph *compile_markov_chain (const MarkovChain *markov_chain)
+{
+  int num_nodes = markov_chain->database->size;
+  int num_edges = 0;
+  for (int i = 0; i < num_nodes; i++)
+  {
+    num_edges += markov_chain->nodes[i]->len_counter_list;
+  }
+  MarkovGraph *graph = malloc (sizeof (MarkovGraph));
+  if (graph == NULL)
+  {
+    return NULL;
+  }
+  *graph = (MarkovGraph) {num_nodes, num_edges,
+                          markov_chain->num_start_nodes,
+                          alloc_array (num_nodes, sizeof (void *)),
+                          alloc_array (num_nodes + 1, sizeof (int)),
+                          alloc_array (num_edges, sizeof (int)),
+                          alloc_array (num_edges, sizeof (int)),
+                          markov_chain->print_func, NULL, NULL, NULL, 0,
+                          markov_chain->write_func, NULL, EXACT_WEIGHTS,
+                          NULL, NULL, NULL, NULL,
+                          alloc_array (markov_chain->num_start_nodes,
+                                       sizeof (int))};
+  if (!graph->data || !graph->offsets || !graph->successors
+      || !graph->weights || !graph->start_nodes)
+  {
+    free_markov_graph (&graph);
+    return NULL;
+  }
+  int edge = 0, start = 0;
+  for (int i = 0; i < num_nodes; i++)
+  {
+    const MarkovNode *markov_node = markov_chain->nodes[i];
+    graph->data[i] = markov_node->data;
+    graph->offsets[i] = edge;
+    if (markov_node->len_counter_list > 0)
+    {
+      graph->start_nodes[start++] = i;
+    }
+    int sum = 0;
+    for (int j = 0; j < markov_node->len_counter_list; j++, edge++)
+    {
+      sum += markov_node->counter_list[j].frequency;
+      graph->successors[edge] = markov_node->counter_list[j].markov_node->id;
+      graph->weights[edge] = sum;
+    }
+  }
+  graph->offsets[num_nodes] = edge;
+  return graph;
+}
+
+static long align_section (long pos)
+{
+  return (pos + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+static bool write_section (FILE *fp, long pos, const void *section,
+                           size_t size)
+/**
+ * Pad the file up to pos and write the section there.
+ * @return true on success, false otherwise
+ */
+{
+  static const char padding[SECTION_ALIGNMENT] = {0};
+  long cur = ftell (fp);
+  return cur >= 0 && cur <= pos
+         && fwrite (padding, 1, pos - cur, fp) == (size_t) (pos - cur)
+         && fwrite (section, 1, size, fp) == size;
+}
+
+static int quantize_weight (long long weight, long long max_weight,
+                            int limit)
+/**
+ * Scale weight so max_weight maps to limit (exactly, if max_weight fits),
+ * rounding to nearest, to at least 1.
+ */
+{
+  if (max_weight <= limit)
+  {
+    return (int) weight;
+  }
+  long long scaled = (weight * limit * 2 + max_weight) / (max_weight * 2);
+  return scaled > 0 ? (int) scaled : 1;
+}
+
+static int edge_weight (const MarkovGraph *graph, int begin, int edge)
+/**
+ * @return the frequency of the edge of an exact graph, whose node's edges
+ * start at begin
+ */
+{
+  return graph->weights[edge] - (edge > begin ? graph->weights[edge - 1] : 0);
+}
+
+static int quantize_node (const MarkovGraph *graph, int node, int limit,
+                          bool renormalize, int *weights, double *deviation)
+/**
+ * Quantize the weights of the node (see quantize_markov_graph) to at most
+ * limit each.
+ * @param weights output, the node's quantized weights
+ * @param deviation updated to the largest difference of the probability of
+ * an edge of the node, if larger
+ * @return the sum of the quantized weights
+ */
+{
+  int begin = graph->offsets[node], end = graph->offsets[node + 1];
+  long long total = graph->weights[end - 1];
+  long long max_weight = 0;
+  for (int e = begin; e < end; e++)
+  {
+    long long weight = edge_weight (graph, begin, e);
+    max_weight = weight > max_weight ? weight : max_weight;
+  }
+  int sum = 0;
+  long long rounded_before = 0;
+  for (int e = begin; e < end; e++)
+  {
+    long long weight = edge_weight (graph, begin, e);
+    if (renormalize) // round the prefix sums, so the weights sum to limit
+    {
+      long long rounded = ((long long) graph->weights[e] * limit * 2 + total)
+                          / (total * 2);
+      weights[e - begin] = (int) (rounded - rounded_before);
+      rounded_before = rounded;
+    }
+    else
+    {
+      weights[e - begin] = quantize_weight (weight, max_weight, limit);
+    }
+    sum += weights[e - begin];
+  }
+  for (int e = begin; e < end; e++)
+  {
+    long long weight = edge_weight (graph, begin, e);
+    double difference = (double) weights[e - begin] / sum
+                        - (double) weight / (double) total;
+    difference = difference < 0 ? -difference : difference;
+    *deviation = difference > *deviation ? difference : *deviation;
+  }
+  return sum;
+}
+
+static int num_blocks (const MarkovGraph *graph)
+/**
+ * @return the number of WEIGHTS_BLOCK edge blocks of the graph
+ */
+{
+  return (graph->num_edges + WEIGHTS_BLOCK - 1) / WEIGHTS_BLOCK;
+}
+
+bool quantize_markov_graph (MarkovGraph *graph, int bits, bool renormalize,
+                            double *max_deviation)
+{
+  if ((bits != WEIGHTS_8_BITS && bits != WEIGHTS_16_BITS)
+      || graph->weight_bits != EXACT_WEIGHTS)
+  {
+    return false;
+  }
+  int limit = (1 << bits) - 1;
+  int max_degree = 1;
+  for (int i = 0; i < graph->num_nodes; i++)
+  {
+    int degree = graph->offsets[i + 1] - graph->offsets[i];
+    max_degree = degree > max_degree ? degree : max_degree;
+  }
+  int *weights = malloc (max_degree * sizeof (int));
+  uint8_t *weights8 = bits == WEIGHTS_8_BITS
+                      ? alloc_array (graph->num_edges, sizeof (uint8_t))
+                      : NULL;
+  uint16_t *weights16 = bits == WEIGHTS_16_BITS
+                        ? alloc_array (graph->num_edges, sizeof (uint16_t))
+                        : NULL;
+  int *totals = renormalize ? NULL : alloc_array (graph->num_nodes,
+                                                  sizeof (int));
+  int *block_sums = alloc_array (num_blocks (graph), sizeof (int));
+  if (weights == NULL || (weights8 == NULL && weights16 == NULL)
+      || (totals == NULL && !renormalize) || block_sums == NULL)
+  {
+    free (weights);
+    free (weights8);
+    free (weights16);
+    free (totals);
+    free (block_sums);
+    return false;
+  }
+  double deviation = 0;
+  for (int i = 0; i < graph->num_nodes; i++)
+  {
+    int begin = graph->offsets[i], degree = graph->offsets[i + 1] - begin;
+    int sum = degree ? quantize_node (graph, i, limit, renormalize, weights,
+                                      &deviation) : 0;
+    int prefix = 0;
+    for (int j = 0; j < degree; j++)
+    {
+      if ((begin + j) % WEIGHTS_BLOCK == 0)
+      {
+        block_sums[(begin + j) / WEIGHTS_BLOCK] = prefix;
+      }
+      prefix += weights[j];
+      if (weights8)
+      {
+        weights8[begin + j] = (uint8_t) weights[j];
+      }
+      else
+      {
+        weights16[begin + j] = (uint16_t) weights[j];
+      }
+    }
+    if (totals)
+    {
+      totals[i] = sum;
+    }
+  }
+  free (weights);
+  if (graph->mapping == NULL) // a mapped graph's weights are in the file
+  {
+    free (graph->weights);
+  }
+  graph->weights = NULL;
+  graph->weight_bits = bits;
+  graph->weights8 = weights8;
+  graph->weights16 = weights16;
+  graph->totals = totals;
+  graph->block_sums = block_sums;
+  if (max_deviation)
+  {
+    *max_deviation = deviation;
+  }
+  return true;
+}
+
+size_t markov_graph_memory (const MarkovGraph *graph)
+{
+  size_t bytes = sizeof (MarkovGraph)
+                 + (graph->num_nodes + 1) * sizeof (int)
+                 + graph->num_edges * sizeof (int);
+  if (graph->data)
+  {
+    bytes += graph->num_nodes * sizeof (void *);
+  }
+  if (graph->weight_bits == EXACT_WEIGHTS)
+  {
+    bytes += graph->num_edges * sizeof (int);
+  }
+  bytes += graph->num_edges * (graph->weight_bits / WEIGHTS_8_BITS);
+  if (graph->totals)
+  {
+    bytes += graph->num_nodes * sizeof (int);
+  }
+  if (graph->block_sums)
+  {
+    bytes += num_blocks (graph) * sizeof (int);
+  }
+  bytes += graph->num_start_nodes * sizeof (int);
+  return bytes;
+}
+
+bool save_markov_graph (const MarkovGraph *graph, data_size_f data_size,
+                        const char *path)
+{
+  if (graph->weight_bits != EXACT_WEIGHTS)
+  {
+    return false;
+  }
+  long *data_offsets = malloc ((graph->num_nodes + 1) * sizeof (long));
+  if (data_offsets == NULL)
+  {
+    return false;
+  }
+  long data_len = 0;
+  for (int i = 0; i < graph->num_nodes; i++)
+  {
+    data_offsets[i] = data_len;
+    data_len = align_section (data_len
+                              + (long) data_size (graph_node_data (graph, i)));
+  }
+  data_offsets[graph->num_nodes] = data_len;
+  GraphFileHeader header = {GRAPH_MAGIC, GRAPH_VERSION, graph->num_nodes,
+                            graph->num_edges, graph->num_start_nodes, 0, 0,
+                            0, 0, 0, 0, 0};
+  header.offsets_pos = align_section (sizeof (header));
+  header.successors_pos = align_section
+      (header.offsets_pos + (graph->num_nodes + 1) * (long) sizeof (int));
+  header.weights_pos = align_section
+      (header.successors_pos + graph->num_edges * (long) sizeof (int));
+  header.data_offsets_pos = align_section
+      (header.weights_pos + graph->num_edges * (long) sizeof (int));
+  header.data_pos = align_section
+      (header.data_offsets_pos + (graph->num_nodes + 1) * (long) sizeof (long));
+  header.file_len = header.data_pos + data_len;
+  // written aside and renamed over path, so processes that have path mapped
+  // keep their (old) file instead of seeing it truncated
+  char *tmp_path = malloc (strlen (path) + sizeof (TMP_SUFFIX));
+  if (tmp_path == NULL)
+  {
+    free (data_offsets);
+    return false;
+  }
+  strcpy (tmp_path, path);
+  strcat (tmp_path, TMP_SUFFIX);
+  FILE *fp = fopen (tmp_path, "wb");
+  bool success = fp != NULL
+      && write_section (fp, 0, &header, sizeof (header))
+      && write_section (fp, header.offsets_pos, graph->offsets,
+                        (graph->num_nodes + 1) * sizeof (int))
+      && write_section (fp, header.successors_pos, graph->successors,
+                        graph->num_edges * sizeof (int))
+      && write_section (fp, header.weights_pos, graph->weights,
+                        graph->num_edges * sizeof (int))
+      && write_section (fp, header.data_offsets_pos, data_offsets,
+                        (graph->num_nodes + 1) * sizeof (long));
+  for (int i = 0; i < graph->num_nodes && success; i++)
+  {
+    void *data = graph_node_data (graph, i);
+    success = write_section (fp, header.data_pos + data_offsets[i], data,
+                             data_size (data));
+  }
+  success = success && write_section (fp, header.file_len, NULL, 0)
+            && fflush (fp) == 0 && fsync (fileno (fp)) == 0;
+  free (data_offsets);
+  if (fp != NULL && fclose (fp) != 0)
+  {
+    success = false;
+  }
+  success = success && rename (tmp_path, path) == 0;
+  if (!success && fp != NULL)
+  {
+    unlink (tmp_path);
+  }
+  free (tmp_path);
+  return success;
+}
+
+static bool valid_header (const GraphFileHeader *header, size_t file_len)
+/**
+ * Check the header of a graph file and that it's sections are in the file.
+ */
+{
+  long nodes_size = (header->num_nodes + 1L) * (long) sizeof (int);
+  long edges_size = header->num_edges * (long) sizeof (int);
+  long data_offsets_size = (header->num_nodes + 1L) * (long) sizeof (long);
+  return memcmp (header->magic, GRAPH_MAGIC, GRAPH_MAGIC_LEN) == 0
+         && header->version == GRAPH_VERSION
+         && header->num_nodes >= 0 && header->num_edges >= 0
+         && header->file_len == (long) file_len
+         && header->offsets_pos >= (long) sizeof (GraphFileHeader)
+         && header->successors_pos >= header->offsets_pos + nodes_size
+         && header->weights_pos >= header->successors_pos + edges_size
+         && header->data_offsets_pos >= header->weights_pos + edges_size
+         && header->data_pos >= header->data_offsets_pos + data_offsets_size
+         && header->data_pos <= header->file_len;
+}
+
+static bool valid_graph (const MarkovGraph *graph, valid_data_f valid_data)
+/**
+ * Check the arrays of a mapped graph, so walking it stays in the file: the
+ * offsets grow from 0 to num_edges, the successors are nodes, the weights
+ * of every node are cumulative (strictly increasing from above 0), the data
+ * offsets grow within the data section, the data of every node is valid (if
+ * there is a valid_data) and num_start_nodes is the number of nodes with a
+ * successor (first_random_node looks for one).
+ */
+{
+  const GraphFileHeader *header = (const GraphFileHeader *) graph->mapping;
+  long data_len = header->file_len - header->data_pos;
+  if (graph->offsets[0] != 0 || graph->offsets[graph->num_nodes]
+                                != graph->num_edges
+      || graph->data_offsets[0] < 0
+      || graph->data_offsets[graph->num_nodes] > data_len)
+  {
+    return false;
+  }
+  int start_nodes = 0;
+  for (int i = 0; i < graph->num_nodes; i++)
+  {
+    int begin = graph->offsets[i], end = graph->offsets[i + 1];
+    if (begin > end || end > graph->num_edges
+        || graph->data_offsets[i] > graph->data_offsets[i + 1]
+        || (valid_data != NULL
+            && !valid_data (graph->data_blob + graph->data_offsets[i],
+                            (size_t) (graph->data_offsets[i + 1]
+                                      - graph->data_offsets[i]))))
+    {
+      return false;
+    }
+    start_nodes += begin < end;
+    for (int e = begin; e < end; e++)
+    {
+      if (graph->successors[e] < 0 || graph->successors[e] >= graph->num_nodes
+          || graph->weights[e] <= (e > begin ? graph->weights[e - 1] : 0))
+      {
+        return false;
+      }
+    }
+  }
+  return graph->num_start_nodes == start_nodes;
+}
+
+MarkovGraph *map_markov_graph (const char *path, print_f print_func,
+                               write_f write_func, valid_data_f valid_data)
+{
+  int fd = open (path, O_RDONLY);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  struct stat file_stat;
+  if (fstat (fd, &file_stat) != 0
+      || file_stat.st_size < (off_t) sizeof (GraphFileHeader))
+  {
+    close (fd);
+    return NULL;
+  }
+  size_t len = (size_t) file_stat.st_size;
+  char *mapping = mmap (NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (mapping == MAP_FAILED)
+  {
+    return NULL;
+  }
+  const GraphFileHeader *header = (const GraphFileHeader *) mapping;
+  MarkovGraph *graph = valid_header (header, len)
+                       ? malloc (sizeof (MarkovGraph)) : NULL;
+  if (graph == NULL)
+  {
+    munmap (mapping, len);
+    return NULL;
+  }
+  *graph = (MarkovGraph) {header->num_nodes, header->num_edges,
+                          header->num_start_nodes, NULL,
+                          (int *) (mapping + header->offsets_pos),
+                          (int *) (mapping + header->successors_pos),
+                          (int *) (mapping + header->weights_pos),
+                          print_func, mapping + header->data_pos,
+                          (const long *) (mapping + header->data_offsets_pos),
+                          mapping, len, write_func, NULL, EXACT_WEIGHTS,
+                          NULL, NULL, NULL, NULL,
+                          alloc_array (header->num_start_nodes, sizeof (int))};
+  if (graph->start_nodes == NULL || !valid_graph (graph, valid_data))
+  {
+    free_markov_graph (&graph);
+    return NULL;
+  }
+  for (int i = 0, start = 0; i < graph->num_nodes; i++)
+  {
+    if (graph->offsets[i] < graph->offsets[i + 1])
+    {
+      graph->start_nodes[start++] = i;
+    }
+  }
+  return graph;
+}
+
+void *graph_node_data (const MarkovGraph *graph, int node)
+{
+  if (graph->data != NULL)
+  {
+    return graph->data[node];
+  }
+  return (void *) (graph->data_blob + graph->data_offsets[node]);
+}
+
+static int first_random_node (const MarkovGraph *graph, RandomStream *stream)
+/**
+ * graph_first_random_node, drawing from the given stream (NULL for rand()):
+ * from a stream in one draw, from the start nodes.
+ */
+{
+  if (graph->num_start_nodes == 0)
+  {
+    return NO_NODE;
+  }
+  if (stream != NULL)
+  {
+    return graph->start_nodes[get_random_number_r (graph->num_start_nodes,
+                                                   stream)];
+  }
+  while (true)
+  {
+    int k = get_random_number_r (graph->num_nodes, stream);
+    if (graph->offsets[k] != graph->offsets[k + 1])
+    {
+      return k;
+    }
+  }
+}
+
+static int next_quantized_node (const MarkovGraph *graph, int node,
+                                RandomStream *stream)
+/**
+ * next_random_node of a quantized graph: binary search the sums of the
+ * node's blocks for the block of the drawn weight, then scan it's weights
+ * (at most WEIGHTS_BLOCK of them).
+ */
+{
+  int edge = graph->offsets[node], end = graph->offsets[node + 1];
+  int total = graph->totals ? graph->totals[node]
+                            : (1 << graph->weight_bits) - 1;
+  int random_weight = get_random_number_r (total, stream);
+  // the node's blocks: the ones that start at one of it's edges
+  int low = (edge + WEIGHTS_BLOCK - 1) / WEIGHTS_BLOCK;
+  int high = (end - 1) / WEIGHTS_BLOCK;
+  if (low <= high && graph->block_sums[low] <= random_weight)
+  {
+    while (low < high) // the last block with a sum <= random_weight
+    {
+      int mid = low + (high - low + 1) / 2;
+      if (graph->block_sums[mid] <= random_weight)
+      {
+        low = mid;
+      }
+      else
+      {
+        high = mid - 1;
+      }
+    }
+    edge = low * WEIGHTS_BLOCK;
+    random_weight -= graph->block_sums[low];
+  }
+  if (graph->weights8)
+  {
+    for (; random_weight >= graph->weights8[edge]; edge++)
+    {
+      random_weight -= graph->weights8[edge];
+    }
+  }
+  else
+  {
+    for (; random_weight >= graph->weights16[edge]; edge++)
+    {
+      random_weight -= graph->weights16[edge];
+    }
+  }
+  return graph->successors[edge];
+}
+
+static int next_random_node (const MarkovGraph *graph, int node,
+                             RandomStream *stream)
+/**
+ * graph_next_random_node, drawing from the given stream (NULL for rand()).
+ */
+{
+  STATS_ADD (samples, 1);
+  if (graph->weight_bits != EXACT_WEIGHTS)
+  {
+    return next_quantized_node (graph, node, stream);
+  }
+  int low = graph->offsets[node], high = graph->offsets[node + 1] - 1;
+  int random_weight = get_random_number_r (graph->weights[high], stream);
+  while (low < high)
+  {
+    int mid = low + (high - low) / 2;
+    if (graph->weights[mid] > random_weight)
+    {
+      high = mid;
+    }
+    else
+    {
+      low = mid + 1;
+    }
+  }
+  return graph->successors[low];
+}
+
+int graph_first_random_node (const MarkovGraph *graph)
+{
+  return first_random_node (graph, NULL);
+}
+
+int graph_next_random_node (const MarkovGraph *graph, int node)
+{
+  return next_random_node (graph, node, NULL);
+}
+
+int graph_random_walk_r (const MarkovGraph *graph, int first_node,
+                         int max_length, int *walk, RandomStream *stream)
+{
+  int cur_node = (first_node == NO_NODE) ? first_random_node (graph, stream)
+                                         : first_node;
+  int length = 0;
+  while (length < max_length && cur_node != NO_NODE)
+  {
+    walk[length++] = cur_node;
+    if (graph->offsets[cur_node] == graph->offsets[cur_node + 1])
+    {
+      break;
+    }
+    // drawn even after the last node, as generate_random_sequence does
+    cur_node = next_random_node (graph, cur_node, stream);
+  }
+  return length;
+}
+
+int graph_random_walk (const MarkovGraph *graph, int first_node,
+                       int max_length, int *walk)
+{
+  return graph_random_walk_r (graph, first_node, max_length, walk, NULL);
+}
+
+static void output_sequence (const MarkovGraph *graph, int first_node,
+                             int max_length, RandomStream *stream,
+                             OutputSink *sink)
+/**
+ * Walk the graph and print the sequence: write it to sink with the graph's
+ * write_func if sink is not NULL, otherwise print it with print_func.
+ */
+{
+  int stack_walk[MAX_STACK_WALK];
+  int *walk = stack_walk;
+  if (max_length > MAX_STACK_WALK)
+  {
+    walk = alloc_array (max_length, sizeof (int));
+    if (walk == NULL)
+    {
+      printf (ALLOCATION_ERROR_MASSAGE);
+      return;
+    }
+  }
+  int length = graph_random_walk_r (graph, first_node, max_length, walk,
+                                    stream);
+  for (int i = 0; i < length; i++)
+  {
+    if (sink)
+    {
+      graph->write_func (graph_node_data (graph, walk[i]), sink);
+    }
+    else
+    {
+      graph->print_func (graph_node_data (graph, walk[i]));
+    }
+  }
+  if (sink)
+  {
+    sink_write_str (sink, NEW_LINE);
+  }
+  else
+  {
+    printf (NEW_LINE);
+  }
+  if (walk != stack_walk)
+  {
+    free (walk);
+  }
+}
+
+void graph_generate_random_sequence (const MarkovGraph *graph,
+                                     int first_node, int max_length)
+{
+  output_sequence (graph, first_node, max_length, NULL,
+                   graph->write_func ? graph->sink : NULL);
+}
+
+void graph_write_random_sequence (const MarkovGraph *graph, int first_node,
+                                  int max_length, RandomStream *stream,
+                                  OutputSink *sink)
+{
+  output_sequence (graph, first_node, max_length, stream, sink);
+}
+
+void free_markov_graph (MarkovGraph **graph)
+{
+  if (*graph == NULL)
+  {
+    return;
+  }
+  free ((*graph)->weights8);
+  free ((*graph)->weights16);
+  free ((*graph)->totals);
+  free ((*graph)->block_sums);
+  free ((*graph)->start_nodes);
+  if ((*graph)->mapping != NULL)
+  {
+    munmap ((*graph)->mapping, (*graph)->mapping_len);
+    free (*graph);
+    *graph = NULL;
+    return;
+  }
+  free ((*graph)->data);
+  free ((*graph)->offsets);
+  free ((*graph)->successors);
+  free ((*graph)->weights);
+  free (*graph);
+  *graph = NULL;
+}
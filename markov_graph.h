@@ -0,0 +1,221 @@
+#ifndef _MARKOV_GRAPH_H
+#define _MARKOV_GRAPH_H
+
+#include <stdint.h> // For uint8_t, uint16_t
+#include "markov_chain.h"
+
+#define NO_NODE -1
+#define GRAPH_MAGIC "MKVG"
+#define GRAPH_MAGIC_LEN 4
+#define GRAPH_VERSION 1
+#define EXACT_WEIGHTS 0
+#define WEIGHTS_8_BITS 8
+#define WEIGHTS_16_BITS 16
+
+/**
+ * Read-only, compressed sparse row (CSR) form of a trained markov chain.
+ * Node i is the state with id i in the chain. Its successors are
+ * successors[offsets[i]] .. successors[offsets[i + 1] - 1] (in the order of
+ * the chain's counter list), and weights[e] is the sum of the frequencies of
+ * the edges offsets[i] .. e (so the last one is the node's total frequency).
+ * A compiled graph refers to the chain's data; a mapped graph (see
+ * map_markov_graph) has all of it's arrays and data in the mapped file.
+ * A quantized graph (see quantize_markov_graph) has no weights array: edge
+ * e has the weight weights8[e] or weights16[e] of it's own, not a sum, and
+ * the sums are kept per block of edges (block_sums).
+ */
+typedef struct MarkovGraph
+{
+    int num_nodes;
+    int num_edges;
+    int num_start_nodes; // nodes with at least one successor
+    void **data; // data of every node, owned by the compiled chain
+    int *offsets; // num_nodes + 1 entries
+    int *successors; // num_edges entries
+    int *weights; // num_edges entries
+    print_f print_func;
+    // mapped graphs: data of node i is at data_blob + data_offsets[i]
+    const char *data_blob;
+    const long *data_offsets;
+    void *mapping; // NULL for a compiled graph
+    size_t mapping_len;
+    // optional output sink, like the chain's (owned by the caller)
+    write_f write_func;
+    OutputSink *sink;
+    // bits of the quantized weights (8 or 16), EXACT_WEIGHTS if the graph
+    // is not quantized
+    int weight_bits;
+    uint8_t *weights8; // num_edges entries if weight_bits is 8, else NULL
+    uint16_t *weights16; // num_edges entries if weight_bits is 16, else NULL
+    // sum of the quantized weights of every node, NULL if they are
+    // renormalized (every node's sum to 2^weight_bits - 1)
+    int *totals;
+    // quantized graphs: the edges are cut to blocks of 16 (edge e is in
+    // block e / 16), and block_sums[b] is the sum of the weights of the
+    // edges of it's node before the block's first edge, so sampling binary
+    // searches the blocks and scans only one
+    int *block_sums;
+    // the nodes with a successor in id order (num_start_nodes entries), so
+    // a first node is drawn from a stream in one draw
+    int *start_nodes;
+} MarkovGraph;
+
+/**
+ * Compile a trained markov_chain to its CSR form. The graph refers to the
+ * chain's data, so the chain must outlive it, and later training of the
+ * chain is not reflected in it.
+ * @param markov_chain the chain to compile
+ * @return pointer to the new graph, NULL in case of allocation error
+ */
+MarkovGraph *compile_markov_chain (const MarkovChain *markov_chain);
+
+/**
+ * Quantize the weights of the graph to bits bits per edge, for a compact
+ * frozen model: with the int successor ids (and an int sum per 16 edges),
+ * an edge takes about 5.25 or 6.25 bytes instead of 8 (and 16 in the
+ * chain's counter lists). Sampling binary searches the sums of the blocks
+ * of 16 edges and scans the weights of one block.
+ * Without renormalize, the frequencies of a node are kept as they are if
+ * they fit, and are scaled down to fit otherwise (to at least 1, so no edge
+ * is lost); with renormalize, they are scaled to sum to 2^bits - 1 in every
+ * node, so no sums are stored (edges with less than 1 / 2^bits of a node's
+ * transitions may get weight 0 and never be drawn). Sampling draws the same
+ * random numbers as before quantizing, only from the quantized
+ * distribution. Quantized graphs can't be saved.
+ * @param graph the graph, not quantized yet (compiled or mapped)
+ * @param bits WEIGHTS_8_BITS or WEIGHTS_16_BITS
+ * @param renormalize true to scale every node's weights to the same sum
+ * @param max_deviation output, the largest difference between the
+ * probability of an edge before and after, may be NULL
+ * @return true on success, false for an invalid number of bits or a graph
+ * that is already quantized, or in case of allocation error (the graph is
+ * left unchanged)
+ */
+bool quantize_markov_graph (MarkovGraph *graph, int bits, bool renormalize,
+                            double *max_deviation);
+
+/**
+ * Count the bytes the graph's arrays take (not the data of the nodes, nor
+ * the file of a mapped graph).
+ * @param graph
+ * @return the number of bytes
+ */
+size_t markov_graph_memory (const MarkovGraph *graph);
+
+/**
+ * Save the graph to a file that map_markov_graph can map. The file is
+ * written to path.tmp and renamed over path, so processes that have the old
+ * file mapped keep reading it. The file is
+ * position independent: it refers to it's arrays and data by offsets from
+ * it's start (native byte order and type sizes):
+ *   header (magic, version, counts, offsets of the sections)
+ *   offsets | successors | weights | data offsets | data
+ * with every section aligned to 8 bytes.
+ * @param graph the graph to save, not quantized
+ * @param data_size function that returns the size of a node's data in bytes
+ * @param path path of the file to write
+ * @return true on success, false if the graph is quantized or the file
+ * can't be written
+ */
+bool save_markov_graph (const MarkovGraph *graph, data_size_f data_size,
+                        const char *path);
+
+/**
+ * Map a file written by save_markov_graph read-only, and walk it in place:
+ * nothing is copied or rebuilt, so mapping is near-instant and processes
+ * that map the same file share one copy of it in the page cache. The file is
+ * checked in one pass over it's nodes and edges (offsets, successors,
+ * cumulative weights, data offsets, data and start nodes), so a corrupted
+ * file is rejected instead of walked out of bounds.
+ * @param path path of the file
+ * @param print_func the function that prints a node's data
+ * @param write_func the function that writes a node's data to a sink, may be
+ * NULL
+ * @param valid_data the function that checks the bytes of a node's data (its
+ * size, padding included), e.g. that a string ends in them, may be NULL
+ * @return pointer to the new graph, NULL if the file can't be mapped or is
+ * not a graph file, or in case of allocation error
+ */
+MarkovGraph *map_markov_graph (const char *path, print_f print_func,
+                               write_f write_func, valid_data_f valid_data);
+
+/**
+ * @param graph
+ * @param node id of a node
+ * @return the data of the node
+ */
+void *graph_node_data (const MarkovGraph *graph, int node);
+
+/**
+ * Get one random node that has at least one successor, drawing exactly
+ * like get_first_random_node.
+ * @param graph
+ * @return id of the node, NO_NODE if no node has a successor
+ */
+int graph_first_random_node (const MarkovGraph *graph);
+
+/**
+ * Choose randomly the next node, depend on it's occurrence frequency,
+ * drawing exactly like get_next_random_node on an unfrozen chain.
+ * @param graph
+ * @param node id of a node with at least one successor
+ * @return id of the chosen node
+ */
+int graph_next_random_node (const MarkovGraph *graph, int node);
+
+/**
+ * Random walk over the graph, like generate_random_sequence without
+ * printing.
+ * @param graph
+ * @param first_node id of the node to start with, NO_NODE to choose a random
+ * one
+ * @param max_length maximum length of the walk
+ * @param walk output, at least max_length entries
+ * @return number of nodes written to walk
+ */
+int graph_random_walk (const MarkovGraph *graph, int first_node,
+                       int max_length, int *walk);
+
+/**
+ * graph_random_walk, drawing from the given stream instead of rand(). The
+ * graph is only read, so threads can walk it at once with their own streams.
+ * @param stream the stream to draw from, NULL for rand()
+ */
+int graph_random_walk_r (const MarkovGraph *graph, int first_node,
+                         int max_length, int *walk, RandomStream *stream);
+
+/**
+ * Generate and print a random sequence out of the graph (to the graph's sink,
+ * if it has one). For the same seed, prints exactly what
+ * generate_random_sequence prints for the (unfrozen) chain the graph was
+ * compiled from.
+ * @param graph
+ * @param first_node id of the node to start with, NO_NODE to choose a random
+ * one
+ * @param max_length maximum length of chain to generate
+ */
+void graph_generate_random_sequence (const MarkovGraph *graph,
+                                     int first_node, int max_length);
+
+/**
+ * Generate a random sequence out of the graph, drawing from the given stream,
+ * and write it to the given sink (with the graph's write_func, which must be
+ * set). Thread safe for distinct streams and sinks.
+ * @param graph
+ * @param first_node id of the node to start with, NO_NODE to choose a random
+ * one
+ * @param max_length maximum length of chain to generate
+ * @param stream the stream to draw from, NULL for rand()
+ * @param sink the sink to write to
+ */
+void graph_write_random_sequence (const MarkovGraph *graph, int first_node,
+                                  int max_length, RandomStream *stream,
+                                  OutputSink *sink);
+
+/**
+ * Free graph and all of it's content from memory
+ * @param graph graph to free
+ */
+void free_markov_graph (MarkovGraph **graph);
+
+#endif /* _MARKOV_GRAPH_H */
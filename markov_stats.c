@@ -0,0 +1,76 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime()
+#include <time.h>
+#include "markov_stats.h"
+
+#define NANO_IN_SEC 1e9
+
+MarkovStats markov_stats;
+
+static const char *const PHASE_NAMES[NUM_PHASES] = {"ingest", "build",
+                                                    "generate", "free"};
+
+bool markov_stats_enabled (void)
+{
+#ifdef MARKOV_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+double markov_stats_now (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / NANO_IN_SEC;
+}
+
+void markov_stats_reset (void)
+{
+  markov_stats = (MarkovStats) {0};
+}
+
+void markov_stats_count (const MarkovChain *markov_chain)
+{
+  long edges = 0;
+  for (int i = 0; i < markov_chain->database->size; i++)
+  {
+    edges += markov_chain->nodes[i]->len_counter_list;
+  }
+  markov_stats.vocabulary = markov_chain->database->size;
+  markov_stats.edges = edges;
+}
+
+static double per (unsigned long count, unsigned long of)
+/**
+ * @return count / of, 0 if of is 0
+ */
+{
+  return of ? (double) count / (double) of : 0;
+}
+
+void print_markov_stats (FILE *out)
+{
+  fprintf (out, "stats: vocabulary %d, edges %ld\n", markov_stats.vocabulary,
+           markov_stats.edges);
+  if (!markov_stats_enabled ())
+  {
+    fprintf (out, "stats: counters disabled (build with -DMARKOV_STATS)\n");
+    return;
+  }
+  fprintf (out, "stats: lookups %lu, %.2f comparisons per lookup\n",
+           markov_stats.lookups,
+           per (markov_stats.lookup_comparisons, markov_stats.lookups));
+  fprintf (out, "stats: successor scans %lu, %.2f comparisons per scan\n",
+           markov_stats.successor_scans,
+           per (markov_stats.successor_comparisons,
+                markov_stats.successor_scans));
+  fprintf (out, "stats: samples %lu\n", markov_stats.samples);
+  fprintf (out, "stats: allocations %lu, %lu bytes\n",
+           markov_stats.allocations, markov_stats.allocated_bytes);
+  for (int phase = 0; phase < NUM_PHASES; phase++)
+  {
+    fprintf (out, "stats: %s %.6fs\n", PHASE_NAMES[phase],
+             markov_stats.phase_seconds[phase]);
+  }
+}
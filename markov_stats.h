@@ -0,0 +1,87 @@
+#ifndef _MARKOV_STATS_H_
+#define _MARKOV_STATS_H_
+#include <stdio.h> // For FILE
+#include "markov_chain.h"
+
+/**
+ * Phases of a run, timed by the program running them.
+ */
+typedef enum StatsPhase
+{
+    PHASE_INGEST, // training (or loading) the chain
+    // compiling (and quantizing) the graph to generate from, 0 when the
+    // tweets are generated from the chain itself
+    PHASE_BUILD,
+    PHASE_GENERATE,
+    PHASE_FREE,
+    NUM_PHASES
+} StatsPhase;
+
+/**
+ * Counters of the chain library, for all the chains of the process. They
+ * are only counted when built with MARKOV_STATS defined (-DMARKOV_STATS),
+ * otherwise the counting macros compile to nothing and they stay 0, except
+ * for the vocabulary and edge counts (see markov_stats_count).
+ */
+typedef struct MarkovStats
+{
+    unsigned long lookups; // database lookups (get_node_from_database)
+    unsigned long lookup_comparisons; // comp_func calls by the lookups
+    // scans of a counter list for a successor (add_node_to_counter_list)
+    unsigned long successor_scans;
+    // successors compared by the scans (by state identity, not comp_func)
+    unsigned long successor_comparisons;
+    unsigned long samples; // next states drawn (get_next_random_node)
+    unsigned long allocations; // state, counter list, index and data
+    unsigned long allocated_bytes;
+    double phase_seconds[NUM_PHASES];
+    int vocabulary; // states of the chain counted last
+    long edges; // transitions of the chain counted last
+} MarkovStats;
+
+extern MarkovStats markov_stats;
+
+#ifdef MARKOV_STATS
+// relaxed atomic adds: training threads count into the same counters
+#define STATS_ADD(counter, amount) \
+  __atomic_fetch_add (&markov_stats.counter, (amount), __ATOMIC_RELAXED)
+#define STATS_START(timer) double timer = markov_stats_now ()
+#define STATS_STOP(phase, timer) \
+  (markov_stats.phase_seconds[phase] += markov_stats_now () - (timer))
+#else
+#define STATS_ADD(counter, amount) ((void) 0)
+#define STATS_START(timer) ((void) 0)
+#define STATS_STOP(phase, timer) ((void) 0)
+#endif
+
+/**
+ * @return true if the library was built with the counters (MARKOV_STATS)
+ */
+bool markov_stats_enabled (void);
+
+/**
+ * @return monotonic wall time in seconds, for the phase timers
+ */
+double markov_stats_now (void);
+
+/**
+ * Zero all the counters and timers.
+ */
+void markov_stats_reset (void);
+
+/**
+ * Count the states and transitions of the chain into markov_stats (done
+ * on demand, so counted with or without MARKOV_STATS).
+ * @param markov_chain
+ */
+void markov_stats_count (const MarkovChain *markov_chain);
+
+/**
+ * Print the counters and timers: lookups and comparisons per lookup,
+ * successor scans and comparisons per scan, samples, allocations and
+ * bytes, the time of every phase and the vocabulary and edge counts.
+ * @param out the stream to print to
+ */
+void print_markov_stats (FILE *out);
+
+#endif /* _MARKOV_STATS_H_ */
@@ -0,0 +1,261 @@
+#include <string.h>
+#include "ngram_chain.h"
+#include "string_chain.h"
+
+static void print_ngram (void *data)
+/**
+ * Print the word ids of the given state (the words are in the vocabulary,
+ * see generate_ngram_sequence).
+ * @param data pointer to an NGram
+ */
+{
+  NGram *ngram = (NGram *) data;
+  printf (" [%d", ngram->words[0]);
+  for (int i = 1; i < MAX_ORDER && ngram->words[i] != NO_WORD; i++)
+  {
+    printf (" %d", ngram->words[i]);
+  }
+  printf ("]");
+}
+
+static int comp_ngram (void *data1, void *data2)
+/**
+ * Compare two states by their word ids.
+ * @param data1 pointer to an NGram
+ * @param data2 pointer to an NGram
+ * @return 0 if equal, non zero otherwise
+ */
+{
+  return memcmp (((NGram *) data1)->words, ((NGram *) data2)->words,
+                 sizeof (((NGram *) data1)->words));
+}
+
+static unsigned long hash_ngram (void *data)
+/**
+ * Hash the word ids of the given state (FNV-1a over their bytes).
+ * @param data pointer to an NGram
+ * @return the hash
+ */
+{
+  const unsigned char *bytes = (const unsigned char *) ((NGram *) data)->words;
+  unsigned long hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < sizeof (((NGram *) data)->words); i++)
+  {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static void *copy_ngram (void *data)
+/**
+ * Copy the given state.
+ * @param data pointer to an NGram
+ * @return pointer to the new NGram, NULL in case of allocation error
+ */
+{
+  NGram *ngram = malloc (sizeof (NGram));
+  if (ngram != NULL)
+  {
+    *ngram = *(NGram *) data;
+  }
+  return ngram;
+}
+
+static void *arena_copy_ngram (void *data, Arena *arena)
+/**
+ * Copy the given state into the arena.
+ * @param data pointer to an NGram
+ * @return pointer to the new NGram, NULL in case of allocation error
+ */
+{
+  NGram *ngram = arena_alloc (arena, sizeof (NGram));
+  if (ngram != NULL)
+  {
+    *ngram = *(NGram *) data;
+  }
+  return ngram;
+}
+
+static size_t size_ngram (void *data)
+{
+  (void) data;
+  return sizeof (NGram);
+}
+
+static bool is_last_ngram (void *data)
+/**
+ * Check if the given state ends a sentence.
+ * @param data pointer to an NGram
+ */
+{
+  return ((NGram *) data)->ends_sentence;
+}
+
+NGramChain *new_ngram_chain (int order)
+{
+  if (order < 1 || order > MAX_ORDER)
+  {
+    return NULL;
+  }
+  NGramChain *ngram_chain = malloc (sizeof (NGramChain));
+  MarkovChain *markov_chain = malloc (sizeof (MarkovChain));
+  LinkedList *list = malloc (sizeof (LinkedList));
+  Arena *states = new_arena (0);
+  MarkovChain *vocabulary = new_string_markov_chain ();
+  if (ngram_chain == NULL || markov_chain == NULL || list == NULL
+      || states == NULL || vocabulary == NULL)
+  {
+    free (ngram_chain);
+    free (markov_chain);
+    free (list);
+    free_arena (states);
+    if (vocabulary != NULL)
+    {
+      free_markov_chain (&vocabulary);
+    }
+    return NULL;
+  }
+  *list = (LinkedList) {NULL, NULL, 0};
+  *markov_chain = (MarkovChain)
+      {list, print_ngram, comp_ngram,
+       free, copy_ngram, is_last_ngram, hash_ngram, NULL,
+       states, arena_copy_ngram, NULL, 0, 0, size_ngram, NULL, NULL,
+       NULL, NULL, NULL, 0, 0};
+  *ngram_chain = (NGramChain) {order, vocabulary, markov_chain, {0}, 0,
+                               NULL};
+  if (!use_node_arena (markov_chain) || !use_node_arena (vocabulary))
+  {
+    free_ngram_chain (&ngram_chain);
+  }
+  return ngram_chain;
+}
+
+static bool train_word (char *word, void *chain)
+/**
+ * Add the word to the vocabulary and, once the sentence has k words, the
+ * state of its last k words to the chain, following the previous state.
+ * @param word the word, used in place (copied if it's new)
+ * @param chain pointer to the NGramChain
+ * @return true on success, false in case of allocation error
+ */
+{
+  NGramChain *ngram_chain = (NGramChain *) chain;
+  MarkovChain *vocabulary = ngram_chain->vocabulary;
+  Node *word_node = add_to_database (vocabulary, word);
+  if (word_node == NULL)
+  {
+    return false;
+  }
+  int order = ngram_chain->order;
+  if (ngram_chain->len_history == order) // slide the window
+  {
+    memmove (ngram_chain->history, ngram_chain->history + 1,
+             (order - 1) * sizeof (int));
+    ngram_chain->len_history--;
+  }
+  ngram_chain->history[ngram_chain->len_history++] = word_node->data->id;
+  bool ends_sentence = word_node->data->is_last;
+  if (ngram_chain->len_history == order)
+  {
+    NGram ngram = {{NO_WORD, NO_WORD, NO_WORD, NO_WORD}, ends_sentence};
+    memcpy (ngram.words, ngram_chain->history, order * sizeof (int));
+    Node *state = add_to_database (ngram_chain->markov_chain, &ngram);
+    if (state == NULL || (ngram_chain->last_state && !add_node_to_counter_list
+        (ngram_chain->last_state, state->data, ngram_chain->markov_chain)))
+    {
+      return false;
+    }
+    ngram_chain->last_state = state->data;
+  }
+  if (ends_sentence) // the next sentence starts a new history
+  {
+    ngram_chain->len_history = 0;
+    ngram_chain->last_state = NULL;
+  }
+  return true;
+}
+
+int ngram_chain_ingest (NGramChain *ngram_chain, const char *text, size_t len,
+                        int *words_to_read)
+{
+  return for_each_word (text, len, words_to_read, train_word, ngram_chain)
+         ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int fill_ngram_chain (const char *path, int words_to_read,
+                      NGramChain *ngram_chain)
+{
+  const char *text;
+  size_t len;
+  if (map_corpus (path, &text, &len))
+  {
+    return EXIT_FAILURE;
+  }
+  int result = ngram_chain_ingest (ngram_chain, text, len, &words_to_read);
+  unmap_corpus (text, len);
+  return result;
+}
+
+static void output_word (MarkovChain *vocabulary, int id, OutputSink *sink)
+/**
+ * Print the word with the given id, to the sink if it's not NULL.
+ */
+{
+  void *word = vocabulary->nodes[id]->data;
+  if (sink)
+  {
+    vocabulary->write_func (word, sink);
+  }
+  else
+  {
+    vocabulary->print_func (word);
+  }
+}
+
+void generate_ngram_sequence (NGramChain *ngram_chain, int max_words,
+                              RandomStream *stream)
+{
+  int order = ngram_chain->order;
+  int max_states = max_words - order + 1 > 0 ? max_words - order + 1 : 1;
+  void **states = malloc (max_states * sizeof (void *));
+  if (states == NULL)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    return;
+  }
+  int length = generate_random_walk (ngram_chain->markov_chain, NULL,
+                                     max_states, NULL, states, stream);
+  OutputSink *sink = ngram_chain->markov_chain->sink;
+  for (int i = 0; i < length; i++)
+  {
+    const NGram *ngram = (const NGram *) states[i];
+    // the first state brings all of it's words, every next one it's last
+    for (int j = (i == 0) ? 0 : order - 1; j < order; j++)
+    {
+      output_word (ngram_chain->vocabulary, ngram->words[j], sink);
+    }
+  }
+  if (sink)
+  {
+    sink_write_str (sink, NEW_LINE);
+  }
+  else
+  {
+    printf (NEW_LINE);
+  }
+  free (states);
+}
+
+size_t ngram_chain_memory (const NGramChain *ngram_chain)
+{
+  return sizeof (NGramChain) + markov_chain_memory (ngram_chain->vocabulary)
+         + markov_chain_memory (ngram_chain->markov_chain);
+}
+
+void free_ngram_chain (NGramChain **ngram_chain)
+{
+  free_markov_chain (&(*ngram_chain)->markov_chain);
+  free_markov_chain (&(*ngram_chain)->vocabulary);
+  free (*ngram_chain);
+  *ngram_chain = NULL;
+}
@@ -0,0 +1,102 @@
+#ifndef _NGRAM_CHAIN_H
+#define _NGRAM_CHAIN_H
+
+#include "markov_chain.h"
+
+#define MAX_ORDER 4
+#define NO_WORD -1
+
+/**
+ * State of an order-k chain: the ids (in the vocabulary) of k consecutive
+ * words of a sentence, fixed width: the ids after the k-th are NO_WORD.
+ */
+typedef struct NGram
+{
+    int words[MAX_ORDER];
+    int ends_sentence; // 1 if the last word ends with a dot, 0 otherwise
+} NGram;
+
+/**
+ * Order-k markov chain over words: every state is an NGram of the last k
+ * words, and generating from a state adds one word. The words are stored
+ * once, in the vocabulary, and the states only refer to them by id.
+ */
+typedef struct NGramChain
+{
+    int order; // k, 1 to MAX_ORDER
+    // string chain holding the words (no transitions): the id of a word is
+    // its index in vocabulary->nodes
+    MarkovChain *vocabulary;
+    // chain over the NGram states, hashed and compared by their word ids
+    MarkovChain *markov_chain;
+    // training state, carried across calls: the ids of the last words of
+    // the current sentence, and the state they make
+    int history[MAX_ORDER];
+    int len_history;
+    MarkovNode *last_state;
+} NGramChain;
+
+/**
+ * Allocate a new empty order-k chain, with it's states (and words) in node
+ * arenas (see use_node_arena).
+ * @param order k, 1 to MAX_ORDER
+ * @return pointer to the new chain, NULL if order is out of range or in case
+ * of allocation error
+ */
+NGramChain *new_ngram_chain (int order);
+
+/**
+ * Add the words of the text to the chain, like markov_chain_ingest: the
+ * first k words of a sentence make its first state, and every next word
+ * makes a state that follows the previous one (a sentence ends with a word
+ * that ends with a dot). Training continues across calls.
+ * @param ngram_chain pointer to the chain
+ * @param text the text, need not be NUL terminated
+ * @param len length of the text
+ * @param words_to_read number of words to read from the text, updated. If
+ * it is negative, the whole text is read.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
+ */
+int ngram_chain_ingest (NGramChain *ngram_chain, const char *text, size_t len,
+                        int *words_to_read);
+
+/**
+ * Fill the chain with the given words from the given file, memory-mapped
+ * and split like fill_database_mmap splits it (lines have no length limit),
+ * so the words are the ones the order-1 chain is trained on.
+ * @param path path of the file, must be a regular file
+ * @param words_to_read number of words to read from the file. If
+ * words_to_read is -1, the function will read the entire file.
+ * @param ngram_chain pointer to the chain
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file can't be mapped
+ * (nothing was read then) or in case of allocation error
+ */
+int fill_ngram_chain (const char *path, int words_to_read,
+                      NGramChain *ngram_chain);
+
+/**
+ * Generate a random sequence of at most max_words words (at least k, from
+ * a random state with a next state) and print it like
+ * generate_random_sequence: to the state chain's sink if it has one.
+ * @param ngram_chain
+ * @param max_words maximum number of words to generate
+ * @param stream the stream to draw from, NULL for rand()
+ */
+void generate_ngram_sequence (NGramChain *ngram_chain, int max_words,
+                              RandomStream *stream);
+
+/**
+ * Count the bytes the chain takes (see markov_chain_memory), vocabulary
+ * included.
+ * @param ngram_chain
+ * @return the number of bytes
+ */
+size_t ngram_chain_memory (const NGramChain *ngram_chain);
+
+/**
+ * Free the chain and all of it's content from memory
+ * @param ngram_chain chain to free
+ */
+void free_ngram_chain (NGramChain **ngram_chain);
+
+#endif /* _NGRAM_CHAIN_H */
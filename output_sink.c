@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 200809L // For write()
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "output_sink.h"
+
+#define DECIMAL 10
+#define MAX_LONG_DIGITS 21 // including the sign
+
+OutputSink *new_output_sink (int fd, size_t capacity)
+{
+  OutputSink *sink = malloc (sizeof (OutputSink));
+  capacity = capacity ? capacity : SINK_DEFAULT_CAPACITY;
+  char *buffer = malloc (capacity);
+  if (sink == NULL || buffer == NULL)
+  {
+    free (sink);
+    free (buffer);
+    return NULL;
+  }
+  *sink = (OutputSink) {buffer, 0, capacity, fd, false};
+  return sink;
+}
+
+bool sink_flush (OutputSink *sink)
+{
+  if (sink->fd == NO_FD)
+  {
+    return !sink->failed;
+  }
+  size_t written = 0;
+  while (written < sink->len)
+  {
+    ssize_t n = write (sink->fd, sink->buffer + written, sink->len - written);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      sink->failed = true;
+      break;
+    }
+    written += (size_t) n;
+  }
+  sink->len = 0;
+  return !sink->failed;
+}
+
+static bool sink_reserve (OutputSink *sink, size_t len)
+/**
+ * Make room for len more bytes in the buffer: flush a file sink, grow a
+ * memory sink.
+ * @return true on success, false if there is no room
+ */
+{
+  if (sink->capacity - sink->len >= len)
+  {
+    return true;
+  }
+  if (sink->fd != NO_FD)
+  {
+    sink_flush (sink);
+    if (sink->capacity >= len)
+    {
+      return true;
+    }
+  }
+  size_t capacity = sink->capacity;
+  while (capacity - sink->len < len)
+  {
+    capacity *= 2;
+  }
+  char *buffer = realloc (sink->buffer, capacity);
+  if (buffer == NULL)
+  {
+    sink->failed = true;
+    return false;
+  }
+  sink->buffer = buffer;
+  sink->capacity = capacity;
+  return true;
+}
+
+bool sink_write (OutputSink *sink, const char *data, size_t len)
+{
+  if (!sink_reserve (sink, len))
+  {
+    return false;
+  }
+  memcpy (sink->buffer + sink->len, data, len);
+  sink->len += len;
+  return !sink->failed;
+}
+
+bool sink_write_str (OutputSink *sink, const char *str)
+{
+  return sink_write (sink, str, strlen (str));
+}
+
+bool sink_write_long (OutputSink *sink, long number)
+{
+  char digits[MAX_LONG_DIGITS];
+  char *end = digits + MAX_LONG_DIGITS, *cur = end;
+  unsigned long magnitude = number < 0 ? 0UL - (unsigned long) number
+                                       : (unsigned long) number;
+  do
+  {
+    *--cur = (char) ('0' + magnitude % DECIMAL);
+    magnitude /= DECIMAL;
+  }
+  while (magnitude > 0);
+  if (number < 0)
+  {
+    *--cur = '-';
+  }
+  return sink_write (sink, cur, end - cur);
+}
+
+void sink_reset (OutputSink *sink)
+{
+  sink->len = 0;
+}
+
+bool free_output_sink (OutputSink *sink)
+{
+  if (sink == NULL)
+  {
+    return true;
+  }
+  bool success = sink_flush (sink);
+  free (sink->buffer);
+  free (sink);
+  return success;
+}
@@ -0,0 +1,69 @@
+#ifndef _OUTPUT_SINK_H_
+#define _OUTPUT_SINK_H_
+#include <stdlib.h> // For malloc(), size_t
+#include <stdbool.h> // for bool
+
+#define NO_FD -1
+#define SINK_DEFAULT_CAPACITY 65536
+
+/**
+ * Output buffer for generated sequences. A file sink is flushed to it's file
+ * descriptor with write(2) when it's full (and on sink_flush); a memory sink
+ * (fd NO_FD) grows instead, and keeps everything written to it in buffer.
+ */
+typedef struct OutputSink {
+    char *buffer;
+    size_t len;
+    size_t capacity;
+    int fd;
+    bool failed; // a write(2) or an allocation failed, output was lost
+} OutputSink;
+
+/**
+ * Allocate a new empty sink.
+ * @param fd file descriptor to flush to, NO_FD for a memory sink
+ * @param capacity size of the buffer (initial size for a memory sink), 0 for
+ * the default
+ * @return pointer to the new sink, NULL in case of allocation error
+ */
+OutputSink *new_output_sink (int fd, size_t capacity);
+
+/**
+ * Write len bytes to the sink.
+ * @return true on success, false if output was lost
+ */
+bool sink_write (OutputSink *sink, const char *data, size_t len);
+
+/**
+ * Write a NUL terminated string to the sink.
+ * @return true on success, false if output was lost
+ */
+bool sink_write_str (OutputSink *sink, const char *str);
+
+/**
+ * Write a number, in decimal, to the sink.
+ * @return true on success, false if output was lost
+ */
+bool sink_write_long (OutputSink *sink, long number);
+
+/**
+ * Write the buffered output of a file sink to it's file descriptor, and
+ * empty the buffer. Does nothing for a memory sink.
+ * @return true on success, false if output was lost
+ */
+bool sink_flush (OutputSink *sink);
+
+/**
+ * Empty the buffer without writing it (for memory sinks, after the caller
+ * consumed it).
+ */
+void sink_reset (OutputSink *sink);
+
+/**
+ * Flush the sink and free it.
+ * @param sink sink to free, may be NULL
+ * @return true on success, false if output was lost
+ */
+bool free_output_sink (OutputSink *sink);
+
+#endif //_OUTPUT_SINK_H_
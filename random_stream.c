@@ -0,0 +1,61 @@
+#include "random_stream.h"
+
+#define GOLDEN_GAMMA 0x9e3779b97f4a7c15ULL
+#define MIX_MULTIPLIER_1 0xbf58476d1ce4e5b9ULL
+#define MIX_MULTIPLIER_2 0x94d049bb133111ebULL
+#define HALF_BITS 32
+
+static uint64_t mix64 (uint64_t z)
+/**
+ * SplitMix64's finalizer: a bijection of 64 bit words that spreads every
+ * input bit over the whole output.
+ */
+{
+  z = (z ^ (z >> 30)) * MIX_MULTIPLIER_1;
+  z = (z ^ (z >> 27)) * MIX_MULTIPLIER_2;
+  return z ^ (z >> 31);
+}
+
+static uint32_t next_random (RandomStream *stream)
+/**
+ * @return the next 32 random bits of the stream
+ */
+{
+  stream->counter++;
+  return (uint32_t) (mix64 (stream->key + stream->counter * GOLDEN_GAMMA)
+                     >> HALF_BITS);
+}
+
+void seed_random_stream (RandomStream *stream, unsigned long seed,
+                         unsigned long index)
+{
+  stream->key = mix64 (mix64 ((uint64_t) seed + GOLDEN_GAMMA)
+                       + (uint64_t) index * GOLDEN_GAMMA);
+  stream->counter = 0;
+}
+
+void random_stream_skip (RandomStream *stream, uint64_t draws)
+{
+  stream->counter += draws;
+}
+
+int random_stream_number (RandomStream *stream, int max_number)
+/**
+ * Lemire's multiply-shift reduction, with rejection of the few values that
+ * would make the low numbers more likely.
+ */
+{
+  uint32_t range = (uint32_t) max_number;
+  uint64_t product = (uint64_t) next_random (stream) * range;
+  uint32_t low = (uint32_t) product;
+  if (low < range)
+  {
+    uint32_t threshold = (0U - range) % range;
+    while (low < threshold)
+    {
+      product = (uint64_t) next_random (stream) * range;
+      low = (uint32_t) product;
+    }
+  }
+  return (int) (product >> HALF_BITS);
+}
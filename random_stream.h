@@ -0,0 +1,43 @@
+#ifndef _RANDOM_STREAM_H_
+#define _RANDOM_STREAM_H_
+#include <stdint.h> // For uint64_t
+
+/**
+ * Private random number generator (SplitMix64), for generating without the
+ * process-global rand(): every stream is derived from a seed and an index
+ * (e.g. the number of the tweet), so streams can be used from any thread,
+ * in any order, and always produce the same numbers.
+ * The generator is counter based: draw n of a stream is a keyed hash of n,
+ * mix64(key + n * gamma), so a stream can skip ahead in constant time.
+ */
+typedef struct RandomStream {
+    uint64_t key; // hash of the seed and the index
+    uint64_t counter; // number of draws so far
+} RandomStream;
+
+/**
+ * Start the stream number index of the given seed.
+ * @param stream stream to start
+ * @param seed the seed
+ * @param index number of the stream
+ */
+void seed_random_stream (RandomStream *stream, unsigned long seed,
+                         unsigned long index);
+
+/**
+ * Get random number between 0 and max_number [0, max_number), without bias.
+ * @param stream the stream to draw from
+ * @param max_number maximal number to return (not including), positive
+ * @return Random number
+ */
+int random_stream_number (RandomStream *stream, int max_number);
+
+/**
+ * Skip the next draws of the stream, in constant time.
+ * @param stream the stream
+ * @param draws number of 32 bit draws to skip (random_stream_number usually
+ * takes one draw per number)
+ */
+void random_stream_skip (RandomStream *stream, uint64_t draws);
+
+#endif //_RANDOM_STREAM_H_
@@ -1,5 +1,6 @@
 #include <string.h> // For strlen(), strcmp(), strcpy()
 #include "markov_chain.h"
+#include "markov_chain_template.h"
 
 #define MAX(X, Y) (((X) < (Y)) ? (Y) : (X))
 #define EMPTY -1
@@ -97,6 +98,92 @@ static int create_board (Cell *cells[BOARD_SIZE])
   return EXIT_SUCCESS;
 }
 
+static bool is_last_cell (void *data)
+{
+  Cell *cell = (Cell *) data;
+  if (cell->number == LAST_CELL)
+  {
+    return true;
+  }
+  return false;
+}
+
+static void *copy_cell (void *data)
+{
+  Cell *cell = (Cell *) data;
+  Cell *new_cell = malloc (sizeof (Cell));
+  if (new_cell == NULL)
+  {
+    return NULL;
+  }
+  *new_cell = (Cell) {cell->number, cell->ladder_to,
+                      cell->snake_to};
+  return new_cell;
+}
+
+static void print_cell (void *data)
+{
+  Cell *cell = (Cell *) data;
+  printf ("[%d]", cell->number);
+  if (cell->ladder_to > 0)
+  {
+    printf ("-ladder to %d", cell->ladder_to);
+  }
+  else if (cell->snake_to > 0)
+  {
+    printf ("-snake to %d", cell->snake_to);
+  }
+  if (cell->number != LAST_CELL)
+  {
+      printf (" -> ");
+  }
+}
+
+static void write_cell (void *data, OutputSink *sink)
+{
+  Cell *cell = (Cell *) data;
+  sink_write_str (sink, "[");
+  sink_write_long (sink, cell->number);
+  sink_write_str (sink, "]");
+  if (cell->ladder_to > 0)
+  {
+    sink_write_str (sink, "-ladder to ");
+    sink_write_long (sink, cell->ladder_to);
+  }
+  else if (cell->snake_to > 0)
+  {
+    sink_write_str (sink, "-snake to ");
+    sink_write_long (sink, cell->snake_to);
+  }
+  if (cell->number != LAST_CELL)
+  {
+    sink_write_str (sink, " -> ");
+  }
+}
+
+static int comp_cell (void *data1, void *data2)
+{
+  Cell *cell1 = (Cell *) data1;
+  Cell *cell2 = (Cell *) data2;
+  return cell1->number - cell2->number;
+}
+
+static unsigned long hash_cell (void *data)
+{
+  Cell *cell = (Cell *) data;
+  return (unsigned long) cell->number;
+}
+
+static size_t size_cell (void *data)
+{
+  (void) data;
+  return sizeof (Cell);
+}
+
+// the board's lookup and generation, with the Cell callbacks inlined
+MARKOV_CHAIN_TEMPLATE (cell, Cell *, hash_cell, comp_cell, print_cell,
+                       write_cell)
+
 /**
  * fills database
  * @param markov_chain
@@ -113,17 +200,17 @@ static int fill_database (MarkovChain *markov_chain)
   size_t index_to;
   for (size_t i = 0; i < BOARD_SIZE; i++)
   {
-    add_to_database (markov_chain, cells[i]);
+    cell_add_to_database (markov_chain, cells[i]);
   }
 
   for (size_t i = 0; i < BOARD_SIZE; i++)
   {
-    from_node = get_node_from_database (markov_chain, cells[i])->data;
+    from_node = cell_get_node_from_database (markov_chain, cells[i])->data;
 
     if (cells[i]->snake_to != EMPTY || cells[i]->ladder_to != EMPTY)
     {
       index_to = MAX(cells[i]->snake_to, cells[i]->ladder_to) - 1;
-      to_node = get_node_from_database (markov_chain, cells[index_to])
+      to_node = cell_get_node_from_database (markov_chain, cells[index_to])
           ->data;
       add_node_to_counter_list
       (from_node, to_node, markov_chain);
@@ -137,7 +224,7 @@ static int fill_database (MarkovChain *markov_chain)
         {
           break;
         }
-        to_node = get_node_from_database
+        to_node = cell_get_node_from_database
             (markov_chain, cells[index_to])->data;
         add_node_to_counter_list
         (from_node, to_node, markov_chain);
@@ -152,54 +239,6 @@ static int fill_database (MarkovChain *markov_chain)
   return EXIT_SUCCESS;
 }
 
-static bool is_last_cell (void *data)
-{
-  Cell *cell = (Cell *) data;
-  if (cell->number == LAST_CELL)
-  {
-    return true;
-  }
-  return false;
-}
-
-static void *copy_cell (void *data)
-{
-  Cell *cell = (Cell *) data;
-  Cell *new_cell = malloc (sizeof (Cell));
-  if (new_cell == NULL)
-  {
-    return NULL;
-  }
-  *new_cell = (Cell) {cell->number, cell->ladder_to,
-                      cell->snake_to};
-  return new_cell;
-}
-
-static void print_cell (void *data)
-{
-  Cell *cell = (Cell *) data;
-  printf ("[%d]", cell->number);
-  if (cell->ladder_to > 0)
-  {
-    printf ("-ladder to %d", cell->ladder_to);
-  }
-  else if (cell->snake_to > 0)
-  {
-    printf ("-snake to %d", cell->snake_to);
-  }
-  if (cell->number != LAST_CELL)
-  {
-      printf (" -> ");
-  }
-}
-
-static int comp_cell (void *data1, void *data2)
-{
-  Cell *cell1 = (Cell *) data1;
-  Cell *cell2 = (Cell *) data2;
-  return cell1->number - cell2->number;
-}
-
 static int check_valid_args (int argc)
 {
   if (argc != ARGS_NUM)
@@ -242,15 +281,17 @@ int main (int argc, char *argv[])
   }
   *markov_chain = (MarkovChain)
       {linked_list, print_cell, comp_cell,
-       free, copy_cell, is_last_cell};
+       free, copy_cell, is_last_cell, hash_cell, NULL, NULL, NULL,
+       NULL, 0, 0, size_cell, write_cell, NULL, NULL,
+       NULL, NULL, 0, 0};
   fill_database (markov_chain);
   int steps_counter = 1;
   while (steps_counter <= turns)
   {
     printf ("Random Walk %d: ", steps_counter);
-    generate_random_sequence
+    cell_generate_random_sequence
         (markov_chain, markov_chain->database->first->data,
-         MAX_GENERATION_LENGTH);
+         MAX_GENERATION_LENGTH, NULL);
     steps_counter++;
   }
   for (int i = 0; i < BOARD_SIZE; i++)
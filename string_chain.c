@@ -0,0 +1,576 @@
+#define _POSIX_C_SOURCE 200809L // For mmap(), open()
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "string_chain.h"
+#include "markov_chain_template.h"
+#include "tokenizer.h"
+
+// constants
+#define WHITE_SPACE " "
+#define END_LINE_CHAR '\n'
+#define END_LINE "\n"
+
+/**
+ * A part of the corpus, trained to its own chain by its own thread.
+ */
+typedef struct Shard
+{
+    const char *text;
+    size_t len;
+    MarkovChain *markov_chain;
+    MarkovNode *last_word; // of the shard, in the shard's chain
+    bool trained; // false if training it failed (allocation error)
+} Shard;
+
+/**
+ * What process_text trains the words of a text to.
+ */
+typedef struct TextTarget
+{
+    MarkovChain *markov_chain;
+    MarkovNode **last_word;
+} TextTarget;
+
+static bool is_last_str (void *data)
+/**
+ * Check if the given string ends with a dot.
+ * @param data pointer to a string
+ * @return true if the string ends with a dot, false otherwise
+ */
+{
+  char *string = (char *) data;
+  unsigned long int last_ind = strlen (string) - 1;
+  if (last_ind == -1)
+  {
+    return false;
+  }
+  if (string[last_ind] == '.')
+  {
+    return true;
+  }
+  return false;
+}
+
+static void *copy_str (void *data)
+/**
+ * Copy the given string.
+ * @param data pointer to a string
+ * @return pointer to the new string
+ */
+{
+  char *str = (char *) data;
+  char *new_str = malloc (strlen (str) + 1);
+  if (new_str == NULL)
+  {
+    return NULL;
+  }
+  strcpy (new_str, str);
+  return new_str;
+}
+
+static void *arena_copy_str (void *data, Arena *arena)
+/**
+ * Intern the given string: copy it into the chain's string arena.
+ * @param data pointer to a string
+ * @param arena the arena to copy the string to
+ * @return pointer to the new string
+ */
+{
+  char *str = (char *) data;
+  size_t size = strlen (str) + 1;
+  char *new_str = arena_alloc (arena, size);
+  if (new_str == NULL)
+  {
+    return NULL;
+  }
+  memcpy (new_str, str, size);
+  return new_str;
+}
+
+static size_t size_str (void *data)
+/**
+ * Get the size of the given string, including the terminating NUL.
+ * @param data pointer to a string
+ * @return the size in bytes
+ */
+{
+  return strlen ((char *) data) + 1;
+}
+
+static bool valid_str (const void *data, size_t size)
+/**
+ * Check that a string ends within the given bytes of a mapped graph.
+ * @param data pointer to the bytes
+ * @param size number of bytes
+ * @return true if there is a terminating NUL in them, false otherwise
+ */
+{
+  return memchr (data, '\0', size) != NULL;
+}
+
+static void print_str (void *data)
+/**
+ * Print the given string.
+ * @param data pointer to a string
+ */
+{
+  char *str = (char *) data;
+  printf (" %s", str);
+}
+
+static void write_str (void *data, OutputSink *sink)
+/**
+ * Write the given string to the sink, like print_str prints it.
+ * @param data pointer to a string
+ */
+{
+  sink_write_str (sink, " ");
+  sink_write_str (sink, (char *) data);
+}
+
+static int comp_str (void *data1, void *data2)
+/**
+ * Compare two strings.
+ * @param data1 pointer to the first string
+ * @param data2 pointer to the second string
+ * @return 0 if the strings are equal, a positive value if the first string is
+ * greater than the second string, and a negative value if the first string is
+ * smaller than the second string
+ */
+{
+  char *str1 = (char *) data1;
+  char *str2 = (char *) data2;
+  return strcmp (str1, str2);
+}
+
+static unsigned long hash_str (void *data)
+/**
+ * Hash the given string (64-bit FNV-1a).
+ * @param data pointer to a string
+ * @return the hash of the string
+ */
+{
+  unsigned long hash = FNV_OFFSET_BASIS;
+  for (const unsigned char *c = data; *c; c++)
+  {
+    hash = (hash ^ *c) * FNV_PRIME;
+  }
+  return hash;
+}
+
+// the string chain's lookup and generation, with the callbacks inlined
+MARKOV_CHAIN_TEMPLATE (string, char *, hash_str, comp_str, print_str,
+                       write_str)
+
+static bool process_word (char *word, struct MarkovChain *markov_chain,
+                          MarkovNode **last_word)
+/**
+ * Process the given word and add it to the database. The word is used in
+ * place, it's only copied (interned) if it's new to the database.
+ * @param word - the word to process and add to the database
+ * @param markov_chain - the markov_chain to add the word to
+ * @param last_word - the last word that was processed, NULL before the first
+ * word, updated to the markov_node of the word
+ * @return true on success, false in case of allocation error
+ */
+{
+  Node *node = string_add_to_database (markov_chain, word);
+  if (node == NULL)
+  {
+    return false;
+  }
+  if (*last_word && !(*last_word)->is_last // word doesn't end with "."
+      && !add_node_to_counter_list (*last_word, node->data, markov_chain))
+  {
+    return false;
+  }
+  *last_word = node->data;
+  return true;
+}
+
+static bool
+process_tweet (char *tweet, int *words_to_read,
+               struct MarkovChain *markov_chain, MarkovNode **last_word)
+/**
+ * The function reads 'words_to_read' words from the tweet and adds them to
+ * the database and updates the last word that was processed.
+ * @param tweet - the tweet to process and add to the database
+ * @param words_to_read - the number of words to read from the tweet
+ * @param markov_chain - the markov_chain to add the tweet to
+ * @param last_word - the last word that was processed
+ * @return true on success, false in case of allocation error
+ */
+{
+  char *word = strtok (tweet, WHITE_SPACE);
+  while (word && *words_to_read)
+  {
+    word[strcspn (word, END_LINE)] = 0;
+    if (!process_word (word, markov_chain, last_word))
+    {
+      return false;
+    }
+    word = strtok (NULL, WHITE_SPACE);
+    (*words_to_read)--;
+  }
+  return true;
+}
+
+int fill_database (FILE *fp, int words_to_read, MarkovChain *markov_chain)
+{
+  char tweet[TWEET_MAX_LEN];
+  MarkovNode **last_word = malloc (sizeof (MarkovNode *));
+  if (last_word == NULL)
+  {
+    fclose (fp);
+    return EXIT_FAILURE;
+  }
+  *last_word = NULL;
+  bool success = true;
+  while (success && fgets (tweet, TWEET_MAX_LEN, fp) && words_to_read != 0)
+  {
+    success = process_tweet (tweet, &words_to_read, markov_chain, last_word);
+  }
+
+  markov_chain->last_ingested = *last_word;
+  free (last_word);
+  fclose (fp);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool for_each_word (const char *text, size_t len, int *words_to_read,
+                    word_f word_func, void *context)
+{
+  char buffer[TWEET_MAX_LEN];
+  char *word = buffer;
+  size_t capacity = sizeof (buffer);
+  size_t pos = 0;
+  Token token;
+  bool success = true;
+  while (success && *words_to_read && next_token (text, len, &pos, &token))
+  {
+    if (token.length >= capacity) // longer than any tweet, copy it aside
+    {
+      if (word != buffer)
+      {
+        free (word);
+      }
+      capacity = token.length + 1;
+      word = malloc (capacity);
+      if (word == NULL)
+      {
+        return false;
+      }
+    }
+    memcpy (word, text + token.offset, token.length);
+    word[token.length] = 0;
+    success = word_func (word, context);
+    (*words_to_read)--;
+  }
+  if (word != buffer)
+  {
+    free (word);
+  }
+  return success;
+}
+
+static bool train_word (char *word, void *target)
+/**
+ * process_word, as the word_f of process_text.
+ * @param target pointer to the TextTarget
+ */
+{
+  TextTarget *text_target = (TextTarget *) target;
+  return process_word (word, text_target->markov_chain,
+                       text_target->last_word);
+}
+
+static bool
+process_text (const char *text, size_t len, int *words_to_read,
+              MarkovChain *markov_chain, MarkovNode **last_word)
+/**
+ * Read 'words_to_read' words from the text (see for_each_word) and add them
+ * to the database. The text is only read, so a mapped corpus stays shared
+ * with the page cache. Lines have no length limit.
+ * @param text - the text, need not be NUL terminated
+ * @param len - length of the text
+ * @param words_to_read - the number of words to read from the text, -1 for
+ * all of them
+ * @param markov_chain - the markov_chain to add the words to
+ * @param last_word - the last word that was processed
+ * @return true on success, false in case of allocation error
+ */
+{
+  TextTarget target = {markov_chain, last_word};
+  return for_each_word (text, len, words_to_read, train_word, &target);
+}
+
+int markov_chain_ingest (MarkovChain *markov_chain, const char *text,
+                         size_t len)
+{
+  int words_to_read = -1;
+  return process_text (text, len, &words_to_read, markov_chain,
+                       &markov_chain->last_ingested)
+         ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int map_corpus (const char *path, const char **text, size_t *len)
+{
+  int fd = open (path, O_RDONLY);
+  if (fd < 0)
+  {
+    return EXIT_FAILURE;
+  }
+  struct stat file_stat;
+  if (fstat (fd, &file_stat) != 0 || !S_ISREG (file_stat.st_mode))
+  {
+    close (fd);
+    return EXIT_FAILURE;
+  }
+  *len = (size_t) file_stat.st_size;
+  *text = NULL;
+  if (*len > 0)
+  {
+    *text = mmap (NULL, *len, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close (fd);
+  if (*text == MAP_FAILED)
+  {
+    return EXIT_FAILURE;
+  }
+  if (*text != NULL)
+  {
+    posix_madvise ((void *) *text, *len, POSIX_MADV_SEQUENTIAL);
+  }
+  return EXIT_SUCCESS;
+}
+
+void unmap_corpus (const char *text, size_t len)
+{
+  if (text != NULL)
+  {
+    munmap ((void *) text, len);
+  }
+}
+
+int fill_database_mmap (const char *path, int words_to_read,
+                        MarkovChain *markov_chain)
+{
+  const char *text;
+  size_t len;
+  if (map_corpus (path, &text, &len))
+  {
+    return EXIT_FAILURE;
+  }
+  MarkovNode *last_word = NULL;
+  bool success = process_text (text, len, &words_to_read, markov_chain,
+                               &last_word);
+  markov_chain->last_ingested = last_word;
+  unmap_corpus (text, len);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void *train_shard (void *shard_ptr)
+/**
+ * Thread routine: fill the shard's chain with all of the shard's words.
+ * @param shard_ptr pointer to the Shard
+ * @return NULL
+ */
+{
+  Shard *shard = (Shard *) shard_ptr;
+  int words_to_read = -1;
+  shard->trained = process_text (shard->text, shard->len, &words_to_read,
+                                 shard->markov_chain, &shard->last_word);
+  return NULL;
+}
+
+static size_t words_prefix_len (const char *text, size_t len,
+                                int words_to_read)
+/**
+ * @return length of the part of the text that holds its first
+ * 'words_to_read' words (the whole text if words_to_read is -1)
+ */
+{
+  size_t pos = 0;
+  Token token;
+  if (words_to_read < 0)
+  {
+    return len;
+  }
+  while (words_to_read-- > 0 && next_token (text, len, &pos, &token))
+  {
+  }
+  return pos;
+}
+
+static void split_shards (const char *text, size_t len, Shard *shards,
+                          int num_shards)
+/**
+ * Split the text to num_shards consecutive parts of about the same length,
+ * cutting after new lines.
+ */
+{
+  size_t start = 0;
+  for (int i = 0; i < num_shards; i++)
+  {
+    size_t end = len;
+    if (i < num_shards - 1)
+    {
+      end = len / num_shards * (i + 1);
+      end = end > start ? end : start;
+      char *new_line = memchr (text + end, END_LINE_CHAR, len - end);
+      end = new_line ? (size_t) (new_line - text) + 1 : len;
+    }
+    shards[i] = (Shard) {text + start, end - start, NULL, NULL, false};
+    start = end;
+  }
+}
+
+static bool merge_shards (MarkovChain *markov_chain, Shard *shards,
+                          int num_shards)
+/**
+ * Merge the chains of shards 1.. (in order) into markov_chain, the chain of
+ * shard 0, adding the transitions between the last word of a shard and the
+ * first word of the next one. Frees the merged chains.
+ * @return true on success, false in case of allocation error
+ */
+{
+  bool success = true;
+  MarkovNode *last_word = shards[0].last_word;
+  for (int i = 1; i < num_shards; i++)
+  {
+    MarkovChain *shard_chain = shards[i].markov_chain;
+    if (success && shard_chain->database->size > 0)
+    {
+      Node *first = string_add_to_database (markov_chain,
+                                            shard_chain->nodes[0]->data);
+      success = first != NULL;
+      if (success && last_word && !last_word->is_last)
+      {
+        success = add_node_to_counter_list (last_word, first->data,
+                                            markov_chain);
+      }
+      success = success && merge_markov_chain (markov_chain, shard_chain);
+      if (success)
+      {
+        last_word = string_get_node_from_database
+            (markov_chain, shards[i].last_word->data)->data;
+      }
+    }
+    free_markov_chain (&shards[i].markov_chain);
+  }
+  markov_chain->last_ingested = last_word;
+  return success;
+}
+
+int fill_database_parallel (const char *path, int words_to_read,
+                            MarkovChain *markov_chain, int num_threads)
+{
+  const char *text;
+  size_t len;
+  if (map_corpus (path, &text, &len))
+  {
+    return EXIT_FAILURE;
+  }
+  size_t train_len = words_prefix_len (text, len, words_to_read);
+  num_threads = num_threads > 0 ? num_threads : 1;
+  // zeroed, so the cleanup below sees no chains if split_shards didn't run
+  Shard *shards = calloc (num_threads, sizeof (Shard));
+  pthread_t *threads = malloc (num_threads * sizeof (pthread_t));
+  bool *started = calloc (num_threads, sizeof (bool));
+  bool success = shards && threads && started;
+  if (success)
+  {
+    split_shards (text, train_len, shards, num_threads);
+    shards[0].markov_chain = markov_chain;
+    for (int i = 1; i < num_threads && success; i++)
+    {
+      shards[i].markov_chain = new_string_markov_chain ();
+      success = shards[i].markov_chain != NULL;
+    }
+  }
+  for (int i = 1; i < num_threads && success; i++)
+  {
+    started[i] = pthread_create (&threads[i], NULL, train_shard,
+                                 &shards[i]) == 0;
+  }
+  if (success)
+  {
+    train_shard (&shards[0]);
+  }
+  for (int i = 1; i < num_threads && success; i++)
+  {
+    if (started[i])
+    {
+      pthread_join (threads[i], NULL);
+    }
+    else
+    {
+      train_shard (&shards[i]); // could not start a thread for it
+    }
+  }
+  for (int i = 0; i < num_threads && success; i++)
+  {
+    success = shards[i].trained;
+  }
+  if (success)
+  {
+    success = merge_shards (markov_chain, shards, num_threads);
+  }
+  else if (shards)
+  {
+    for (int i = 1; i < num_threads && shards[i].markov_chain; i++)
+    {
+      free_markov_chain (&shards[i].markov_chain);
+    }
+  }
+  free (shards);
+  free (threads);
+  free (started);
+  unmap_corpus (text, len);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+MarkovChain *new_string_markov_chain (void)
+{
+  MarkovChain *markov_chain = malloc (sizeof (MarkovChain));
+  LinkedList *list = malloc (sizeof (LinkedList));
+  Arena *strings = new_arena (0);
+  if (markov_chain == NULL || list == NULL || strings == NULL)
+  {
+    free (markov_chain);
+    free (list);
+    free_arena (strings);
+    return NULL;
+  }
+  *list = (LinkedList) {NULL, NULL, 0};
+  *markov_chain = (MarkovChain)
+      {list, print_str, comp_str,
+       free, copy_str, is_last_str, hash_str, NULL,
+       strings, arena_copy_str, NULL, 0, 0, size_str, write_str, NULL,
+       NULL, NULL, NULL, 0, 0};
+  return markov_chain;
+}
+
+MarkovGraph *map_string_markov_graph (const char *path)
+{
+  return map_markov_graph (path, print_str, write_str, valid_str);
+}
+
+Node *get_string_node (MarkovChain *markov_chain, char *word)
+{
+  return string_get_node_from_database (markov_chain, word);
+}
+
+void generate_string_sequence (MarkovChain *markov_chain,
+                               MarkovNode *first_node, int max_length,
+                               RandomStream *stream)
+{
+  string_generate_random_sequence (markov_chain, first_node, max_length,
+                                   stream);
+}
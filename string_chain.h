@@ -0,0 +1,154 @@
+#ifndef _STRING_CHAIN_H
+#define _STRING_CHAIN_H
+
+#include "markov_chain.h"
+#include "markov_graph.h"
+
+// longest line of the corpus (with its new line and NUL): fill_database
+// reads lines of up to this length, and shorter words are terminated on the
+// stack when tokenizing a text (see for_each_word)
+#define TWEET_MAX_LEN 1001
+// 64-bit FNV-1a, the hash of the chains' states
+#define FNV_OFFSET_BASIS 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+typedef bool (*word_f) (char *, void *);
+
+/**
+ * Allocate a new markov_chain over string (word) states, with an empty
+ * database and the string callbacks (print, compare, copy, hash, is_last).
+ * Words are interned: every distinct word is stored once, in the chain's
+ * string arena, and is released with it.
+ * @return pointer to the new markov_chain, NULL in case of allocation error
+ */
+MarkovChain *new_string_markov_chain (void);
+
+/**
+ * Fill the markov_chain's database with the given words from the given file.
+ * @param fp pointer to the file, closed by the function
+ * @param words_to_read number of words to read from the file. If
+ * words_to_read is -1, the function will read the entire file.
+ * @param markov_chain pointer to the markov_chain
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
+ */
+int fill_database (FILE *fp, int words_to_read, MarkovChain *markov_chain);
+
+/**
+ * Fill the markov_chain's database with the given words from the given file,
+ * like fill_database, but without reading it through a buffer: the file is
+ * memory-mapped read-only and tokenized where it's mapped (each word is
+ * terminated in a copy on the stack, new words are interned), so the corpus
+ * is never copied whole and lines have no length limit.
+ * @param path path of the file, must be a regular file
+ * @param words_to_read number of words to read from the file. If
+ * words_to_read is -1, the function will read the entire file.
+ * @param markov_chain pointer to the markov_chain
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file can't be mapped
+ * (nothing was read then) or in case of allocation error (the words read
+ * until then were trained)
+ */
+int fill_database_mmap (const char *path, int words_to_read,
+                        MarkovChain *markov_chain);
+
+/**
+ * Fill the markov_chain's database with the given words from the given file,
+ * like fill_database_mmap, with num_threads threads: the words are split to
+ * num_threads parts at line boundaries, each thread trains its own chain on
+ * its part, and the chains are merged in order (see merge_markov_chain),
+ * with the transitions across the parts' boundaries. The result is the same
+ * chain fill_database_mmap builds.
+ * @param path path of the file, must be a regular file
+ * @param words_to_read number of words to read from the file. If
+ * words_to_read is -1, the function will read the entire file.
+ * @param markov_chain pointer to the markov_chain, must be empty
+ * @param num_threads number of threads to train with
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file can't be mapped
+ * or in case of allocation error
+ */
+int fill_database_parallel (const char *path, int words_to_read,
+                            MarkovChain *markov_chain, int num_threads);
+
+/**
+ * Add the words of the text to the markov_chain, continuing from the last
+ * word trained (by an earlier call, or by fill_database and its variants),
+ * like training on the concatenation of the texts. The text is split like
+ * the corpus (see next_token), and its end ends a word. Costs only the new
+ * words: the chain stays valid for generation between calls (a frozen state
+ * that gets new successors goes back to linear sampling, and graphs compiled
+ * before are not updated).
+ * @param markov_chain pointer to the markov_chain
+ * @param text the new text (e.g. tweets or lines), need not be NUL terminated
+ * @param len length of the text
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
+ */
+int markov_chain_ingest (MarkovChain *markov_chain, const char *text,
+                         size_t len);
+
+/**
+ * Find the node of the word in a string markov_chain, like
+ * get_node_from_database, with the string callbacks bound at compile time
+ * (see MARKOV_CHAIN_TEMPLATE).
+ * @param markov_chain pointer to a string markov_chain
+ * @param word the word to look for
+ * @return the node of the word, NULL if it's not in the database
+ */
+Node *get_string_node (MarkovChain *markov_chain, char *word);
+
+/**
+ * Generate a random sequence of words from a string markov_chain, like
+ * generate_random_sequence_r, with the string callbacks bound at compile
+ * time (see MARKOV_CHAIN_TEMPLATE). Same output for the same stream.
+ * @param markov_chain pointer to a string markov_chain
+ * @param first_node markov_node to start with, if NULL- choose a random
+ * markov_node
+ * @param max_length maximum length of the sequence
+ * @param stream the stream to draw from, NULL for rand()
+ */
+void generate_string_sequence (MarkovChain *markov_chain,
+                               MarkovNode *first_node, int max_length,
+                               RandomStream *stream);
+
+/**
+ * Split the text into words like the corpus (see next_token), and call
+ * word_func on each of them, terminated (in a copy, so the text is only
+ * read) and with the given context, until it fails.
+ * @param text the text, need not be NUL terminated
+ * @param len length of the text
+ * @param words_to_read number of words to read from the text, updated. If
+ * it is negative, the whole text is read.
+ * @param word_func the function to call on every word, returns false to
+ * stop (in case of allocation error)
+ * @param context passed to word_func
+ * @return true on success, false if word_func failed or in case of
+ * allocation error
+ */
+bool for_each_word (const char *text, size_t len, int *words_to_read,
+                    word_f word_func, void *context);
+
+/**
+ * Map the text corpus read-only and shared, so tokenizing it (see next_token)
+ * reads the page cache instead of a copy of the file.
+ * @param path path of the file, must be a regular file
+ * @param text output, the mapped text (NULL for an empty file)
+ * @param len output, length of the text
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file can't be mapped
+ */
+int map_corpus (const char *path, const char **text, size_t *len);
+
+/**
+ * Unmap a text mapped by map_corpus.
+ * @param text the mapped text, may be NULL
+ * @param len length of the text
+ */
+void unmap_corpus (const char *text, size_t len);
+
+/**
+ * Map a graph file saved from a string markov_chain (see map_markov_graph),
+ * checking that the data of every node is a terminated string.
+ * @param path path of the file
+ * @return pointer to the new graph, NULL if the file can't be mapped or is
+ * not a graph file, or in case of allocation error
+ */
+MarkovGraph *map_string_markov_graph (const char *path);
+
+#endif /* _STRING_CHAIN_H */
@@ -0,0 +1,94 @@
+#include "tokenizer.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SIMD_TOKENIZER
+#endif
+
+#define SPACE_CHAR ' '
+#define END_LINE_CHAR '\n'
+#define SSE2_WIDTH 16
+#define AVX2_WIDTH 32
+
+size_t find_separator_scalar (const char *text, size_t len)
+{
+  size_t i = 0;
+  while (i < len && text[i] != SPACE_CHAR && text[i] != END_LINE_CHAR)
+  {
+    i++;
+  }
+  return i;
+}
+
+#ifdef SIMD_TOKENIZER
+static size_t find_separator_sse2 (const char *text, size_t len)
+{
+  const __m128i spaces = _mm_set1_epi8 (SPACE_CHAR);
+  const __m128i end_lines = _mm_set1_epi8 (END_LINE_CHAR);
+  size_t i = 0;
+  for (; i + SSE2_WIDTH <= len; i += SSE2_WIDTH)
+  {
+    __m128i block = _mm_loadu_si128 ((const __m128i *) (text + i));
+    __m128i matches = _mm_or_si128 (_mm_cmpeq_epi8 (block, spaces),
+                                    _mm_cmpeq_epi8 (block, end_lines));
+    int mask = _mm_movemask_epi8 (matches);
+    if (mask != 0)
+    {
+      return i + __builtin_ctz (mask);
+    }
+  }
+  return i + find_separator_scalar (text + i, len - i);
+}
+
+__attribute__ ((target ("avx2")))
+static size_t find_separator_avx2 (const char *text, size_t len)
+{
+  const __m256i spaces = _mm256_set1_epi8 (SPACE_CHAR);
+  const __m256i end_lines = _mm256_set1_epi8 (END_LINE_CHAR);
+  size_t i = 0;
+  for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH)
+  {
+    __m256i block = _mm256_loadu_si256 ((const __m256i *) (text + i));
+    __m256i matches = _mm256_or_si256 (_mm256_cmpeq_epi8 (block, spaces),
+                                       _mm256_cmpeq_epi8 (block, end_lines));
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8 (matches);
+    if (mask != 0)
+    {
+      return i + __builtin_ctz (mask);
+    }
+  }
+  return i + find_separator_sse2 (text + i, len - i);
+}
+#endif
+
+size_t find_separator (const char *text, size_t len)
+{
+#ifdef SIMD_TOKENIZER
+  if (__builtin_cpu_supports ("avx2"))
+  {
+    return find_separator_avx2 (text, len);
+  }
+  return find_separator_sse2 (text, len);
+#else
+  return find_separator_scalar (text, len);
+#endif
+}
+
+bool next_token (const char *text, size_t len, size_t *pos, Token *token)
+{
+  size_t cur = *pos;
+  while (cur < len && text[cur] == SPACE_CHAR)
+  {
+    cur++;
+  }
+  if (cur == len)
+  {
+    *pos = cur;
+    return false;
+  }
+  size_t length = find_separator (text + cur, len - cur);
+  *token = (Token) {cur, length};
+  // step over the separator, unless the text ended without one
+  *pos = cur + length + (cur + length < len);
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef _TOKENIZER_H_
+#define _TOKENIZER_H_
+#include <stdlib.h> // For size_t
+#include <stdbool.h> // for bool
+
+/**
+ * A word of a text, as found by next_token().
+ */
+typedef struct Token {
+    size_t offset; // index of the first character in the text
+    size_t length; // not including the separator
+} Token;
+
+/**
+ * Find the first separator (space or new line) of the text, scanning 32
+ * (AVX2) or 16 (SSE2) bytes at a time where the CPU supports it.
+ * @param text text to scan
+ * @param len length of the text
+ * @return index of the separator, len if there is none
+ */
+size_t find_separator (const char *text, size_t len);
+
+/**
+ * Same as find_separator(), one byte at a time.
+ */
+size_t find_separator_scalar (const char *text, size_t len);
+
+/**
+ * Find the next word of the text from *pos on: words are separated by spaces
+ * and new lines, and a new line that does not follow a word (an empty line,
+ * or a line ending with a space) ends an empty word. This is how the corpus
+ * is split into words by fill_database().
+ * @param text text to scan
+ * @param len length of the text
+ * @param pos position to scan from, advanced past the word and its
+ * separator
+ * @param token output, the word found
+ * @return true if a word was found, false at the end of the text
+ */
+bool next_token (const char *text, size_t len, size_t *pos, Token *token);
+
+#endif //_TOKENIZER_H_
@@ -1,181 +1,703 @@
+#define _POSIX_C_SOURCE 200809L // For pthread
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h> // For STDOUT_FILENO
+#include <pthread.h>
 #include "linked_list.h"
 #include "markov_chain.h"
+#include "string_chain.h"
+#include "ngram_chain.h"
+#include "markov_stats.h"
 
 // messages
 #define ARG_ERR_MSG "Usage: The number of arguments is invalid.\n"
 #define FILE_ERR_MSG "Error: The given file is invalid.\n"
 #define ALLOCATION_ERR_MSG "Allocation failure: there was problem to create markov_chain"
+#define NO_START_ERR_MSG \
+"Error: No word in the text corpus can start a tweet.\n"
+#define LOAD_ERR_MSG "Error: The given model is invalid.\n"
+#define SAVE_ERR_MSG "Error: Failed to save the model.\n"
+#define PRUNE_MSG "pruned: states %d -> %d, edges %ld -> %ld, " \
+"bytes %zu -> %zu, transitions removed %.2f%%, max deviation %.4f\n"
+#define PERCENT 100
+#define ORDER_MSG "order %d: states %d, edges %ld, words %d, bytes %zu, " \
+"bytes per state %.1f\n"
+#define QUANTIZE_MSG "quantized: %d bit weights, graph bytes %zu -> %zu, " \
+"max deviation %.6f\n"
 // constants
-#define TWEET_MAX_LEN 1001
 #define MAX_WORDS_IN_TWEET 20
 #define MIN_ARGS_NUM 4
 #define MAX_ARGS_NUM 5
+#define LOAD_ARGS_NUM 3
 #define SEED_IND 1
 #define TWEETS_IND 2
 #define TEXT_CORPUS_IND 3
 #define WORDS_TO_READ_IND 4
-#define WHITE_SPACE " "
-#define END_LINE "\n"
 #define DECIMAL 10
+#define OPTION_PREFIX "--"
+#define THREADS_OPTION "--threads"
+#define SAVE_OPTION "--save"
+#define LOAD_OPTION "--load"
+#define SAVE_GRAPH_OPTION "--save-graph"
+#define MAP_OPTION "--map"
+#define GEN_THREADS_OPTION "--gen-threads"
+#define FIRST_TWEET_OPTION "--first-tweet"
+#define ORDER_OPTION "--order"
+#define STATS_OPTION "--stats"
+#define PRUNE_COUNT_OPTION "--prune-count"
+#define PRUNE_PROBABILITY_OPTION "--prune-probability"
+#define QUANTIZE_OPTION "--quantize"
+#define RENORMALIZE_OPTION "--renormalize"
+#define DEFAULT_THREADS 1
+#define TWEET_PREFIX "Tweet "
+#define TWEET_SEPARATOR ":"
+#define TWEETS_PER_TASK 4096
+#define FIRST_TWEET 1
+#define DEFAULT_ORDER 1
 
-static bool is_last_str (void *data)
 /**
- * Check if the given string ends with a dot.
- * @param data pointer to a string
- * @return true if the string ends with a dot, false otherwise
+ * Command line options, given as "--name value" anywhere in the arguments.
  */
+typedef struct Options
 {
-  char *string = (char *) data;
-  unsigned long int last_ind = strlen (string) - 1;
-  if (last_ind == -1)
+    int threads; // number of threads to train with
+    char *save_path; // save the trained model there, NULL not to save
+    char *load_path; // load the model instead of training, NULL to train
+    char *save_graph_path; // save the compiled graph there, NULL not to save
+    char *map_path; // generate from this mapped graph file, NULL not to
+    // number of threads to generate with, from per-tweet random streams
+    // instead of rand(); 0 to generate serially with rand()
+    int gen_threads;
+    // number of the first tweet to generate, from the per-tweet random
+    // streams (so tweet i is the same whichever tweets are generated with it)
+    long first_tweet;
+    int order; // order of the chain, words per state
+    bool stats; // print the library's stats to stderr at the end
+    // prune the chain (see prune_markov_chain) after training or loading:
+    // states and transitions seen less times, transitions with a smaller
+    // probability. 0 not to prune
+    int prune_count;
+    double prune_probability;
+    // generate from the graph with weights quantized to this many bits (see
+    // quantize_markov_graph), EXACT_WEIGHTS not to quantize
+    int quantize_bits;
+    bool renormalize;
+} Options;
+
+static int check_valid_args (int args, const Options *options)
+/**
+ * Check if the number of arguments is valid: a loaded model or a mapped
+ * graph replaces the text corpus (and the number of words to read from it).
+ * Chains of a higher order are only trained from a text corpus, by one
+ * thread. Weights are quantized to 8 or 16 bits.
+ * @param args the number of arguments
+ * @param options the command line options
+ * @return EXIT_SUCCESS if the number of arguments is valid, EXIT_FAILURE
+ * otherwise
+ */
+{
+  if ((options->load_path || options->map_path) ? args != LOAD_ARGS_NUM
+                         : (args < MIN_ARGS_NUM || args > MAX_ARGS_NUM))
   {
-    return false;
+    printf (ARG_ERR_MSG);
+    return EXIT_FAILURE;
   }
-  if (string[last_ind] == '.')
+  if (options->order != DEFAULT_ORDER
+      && (options->order < 1 || options->order > MAX_ORDER
+          || options->load_path || options->map_path || options->save_path
+          || options->save_graph_path || options->threads > 1
+          || options->prune_count || options->prune_probability
+          || options->quantize_bits))
   {
-    return true;
+    printf (ARG_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  if (options->quantize_bits != EXACT_WEIGHTS
+      && options->quantize_bits != WEIGHTS_8_BITS
+      && options->quantize_bits != WEIGHTS_16_BITS)
+  {
+    printf (ARG_ERR_MSG);
+    return EXIT_FAILURE;
   }
-  return false;
+  return EXIT_SUCCESS;
 }
 
-static void *copy_str (void *data)
+static int parse_options (int *args, char **argv, Options *options)
 /**
- * Copy the given string.
- * @param data pointer to a string
- * @return pointer to the new string
+ * Read the options from the arguments and remove them, leaving the other
+ * arguments in order. All options but --stats and --renormalize take a value.
+ * @param args the number of arguments, updated
+ * @param argv the arguments, updated
+ * @param options output, the options (defaults for the ones not given)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE for an unknown option or an
+ * option without a value
  */
 {
-  char *str = (char *) data;
-  char *new_str = malloc (strlen (str) + 1);
-  if (new_str == NULL)
+  *options = (Options) {DEFAULT_THREADS, NULL, NULL, NULL, NULL, 0,
+                        FIRST_TWEET, DEFAULT_ORDER, false, 0, 0,
+                        EXACT_WEIGHTS, false};
+  int kept = 1;
+  for (int i = 1; i < *args; i++)
   {
-    return NULL;
+    if (strcmp (argv[i], THREADS_OPTION) == 0 && i + 1 < *args)
+    {
+      options->threads = (int) strtol (argv[++i], NULL, DECIMAL);
+    }
+    else if (strcmp (argv[i], SAVE_OPTION) == 0 && i + 1 < *args)
+    {
+      options->save_path = argv[++i];
+    }
+    else if (strcmp (argv[i], LOAD_OPTION) == 0 && i + 1 < *args)
+    {
+      options->load_path = argv[++i];
+    }
+    else if (strcmp (argv[i], SAVE_GRAPH_OPTION) == 0 && i + 1 < *args)
+    {
+      options->save_graph_path = argv[++i];
+    }
+    else if (strcmp (argv[i], MAP_OPTION) == 0 && i + 1 < *args)
+    {
+      options->map_path = argv[++i];
+    }
+    else if (strcmp (argv[i], GEN_THREADS_OPTION) == 0 && i + 1 < *args)
+    {
+      options->gen_threads = (int) strtol (argv[++i], NULL, DECIMAL);
+    }
+    else if (strcmp (argv[i], FIRST_TWEET_OPTION) == 0 && i + 1 < *args)
+    {
+      options->first_tweet = strtol (argv[++i], NULL, DECIMAL);
+      // tweets other than the first ones only exist in the random streams
+      options->gen_threads = options->gen_threads ? options->gen_threads : 1;
+    }
+    else if (strcmp (argv[i], ORDER_OPTION) == 0 && i + 1 < *args)
+    {
+      options->order = (int) strtol (argv[++i], NULL, DECIMAL);
+    }
+    else if (strcmp (argv[i], PRUNE_COUNT_OPTION) == 0 && i + 1 < *args)
+    {
+      options->prune_count = (int) strtol (argv[++i], NULL, DECIMAL);
+    }
+    else if (strcmp (argv[i], PRUNE_PROBABILITY_OPTION) == 0
+             && i + 1 < *args)
+    {
+      options->prune_probability = strtod (argv[++i], NULL);
+    }
+    else if (strcmp (argv[i], QUANTIZE_OPTION) == 0 && i + 1 < *args)
+    {
+      options->quantize_bits = (int) strtol (argv[++i], NULL, DECIMAL);
+    }
+    else if (strcmp (argv[i], RENORMALIZE_OPTION) == 0)
+    {
+      options->renormalize = true;
+    }
+    else if (strcmp (argv[i], STATS_OPTION) == 0)
+    {
+      options->stats = true;
+    }
+    else if (strncmp (argv[i], OPTION_PREFIX, strlen (OPTION_PREFIX)) == 0)
+    {
+      printf (ARG_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+    else
+    {
+      argv[kept++] = argv[i];
+    }
   }
-  strcpy (new_str, str);
-  return new_str;
+  *args = kept;
+  argv[kept] = NULL;
+  return EXIT_SUCCESS;
 }
 
-static void print_str (void *data)
+static int train (char *path, int words_to_read, const Options *options,
+                  MarkovChain *markov_chain)
 /**
- * Print the given string.
- * @param data pointer to a string
+ * Fill the markov_chain's database from the text corpus: memory-mapped, with
+ * options->threads threads, or through a buffer if the file can't be mapped.
+ * @param path path of the text corpus
+ * @param words_to_read number of words to read, -1 for all of them
+ * @param options the command line options
+ * @param markov_chain the chain to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
+ * (the chain is partly trained then)
  */
 {
-  char *str = (char *) data;
-  printf (" %s", str);
+  if (options->threads > 1)
+  {
+    if (fill_database_parallel (path, words_to_read, markov_chain,
+                                options->threads) == EXIT_SUCCESS)
+    {
+      return EXIT_SUCCESS;
+    }
+    // failed after merging some of the shards: retrying serially would
+    // train them twice
+    if (markov_chain->database->size > 0)
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  if (fill_database_mmap (path, words_to_read, markov_chain) == EXIT_SUCCESS)
+  {
+    return EXIT_SUCCESS;
+  }
+  if (markov_chain->database->size > 0) // failed after reading some words
+  {
+    return EXIT_FAILURE;
+  }
+  // not a mappable file (e.g. a pipe), read it through a buffer
+  FILE *input = NULL;
+  input = fopen (path, "r");
+  return fill_database (input, words_to_read, markov_chain);
 }
 
-static int comp_str (void *data1, void *data2)
+static int prune (MarkovChain *markov_chain, const Options *options)
 /**
- * Compare two strings.
- * @param data1 pointer to the first string
- * @param data2 pointer to the second string
- * @return 0 if the strings are equal, a positive value if the first string is
- * greater than the second string, and a negative value if the first string is
- * smaller than the second string
+ * Prune the markov_chain as the options ask to, and print what was removed
+ * to stderr (so it doesn't mix with the tweets).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
  */
 {
-  char *str1 = (char *) data1;
-  char *str2 = (char *) data2;
-  return strcmp (str1, str2);
+  PruneReport report;
+  if (!prune_markov_chain (markov_chain, options->prune_count,
+                           options->prune_count, options->prune_probability,
+                           &report))
+  {
+    printf (ALLOCATION_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  fprintf (stderr, PRUNE_MSG, report.states_before, report.states_after,
+           report.edges_before, report.edges_after, report.bytes_before,
+           report.bytes_after, report.mass_removed * PERCENT,
+           report.max_deviation);
+  return EXIT_SUCCESS;
 }
 
-static MarkovNode *process_word (char *word, struct MarkovChain *markov_chain,
-                                 MarkovNode **last_word)
+static int build_chain (int args, char **argv, const Options *options,
+                        MarkovChain *markov_chain)
+/**
+ * Fill the markov_chain: load it from the model file, or train it on the
+ * text corpus, then prune it and save it if asked to.
+ * @param args the number of arguments
+ * @param argv the arguments
+ * @param options the command line options
+ * @param markov_chain the (empty) chain to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  if (options->load_path)
+  {
+    if (!load_markov_chain (markov_chain, options->load_path))
+    {
+      printf (LOAD_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    long int words_to_read = -1;
+    if (args == MAX_ARGS_NUM)
+    {
+      words_to_read = strtol (argv[WORDS_TO_READ_IND], NULL, DECIMAL);
+    }
+    if (train (argv[TEXT_CORPUS_IND], words_to_read, options, markov_chain))
+    {
+      printf (ALLOCATION_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  }
+  if ((options->prune_count || options->prune_probability)
+      && prune (markov_chain, options) == EXIT_FAILURE)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options->save_path
+      && !save_markov_chain (markov_chain, options->save_path))
+  {
+    printf (SAVE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static int save_graph (MarkovChain *markov_chain, const char *path)
+/**
+ * Compile the markov_chain and save it as a graph file.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  STATS_START (build);
+  MarkovGraph *graph = compile_markov_chain (markov_chain);
+  STATS_STOP (PHASE_BUILD, build);
+  if (graph == NULL)
+  {
+    printf (ALLOCATION_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  bool saved = save_markov_graph (graph, markov_chain->data_size, path);
+  free_markov_graph (&graph);
+  if (!saved)
+  {
+    printf (SAVE_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static OutputSink *open_stdout_sink (void)
+/**
+ * Allocate a sink over the standard output, for the tweets. Anything printed
+ * before is flushed first, so the output stays in order.
+ * @return pointer to the new sink, NULL in case of allocation error
+ */
+{
+  fflush (stdout);
+  OutputSink *sink = new_output_sink (STDOUT_FILENO, SINK_DEFAULT_CAPACITY);
+  if (sink == NULL)
+  {
+    printf (ALLOCATION_ERR_MSG);
+  }
+  return sink;
+}
+
+static void write_tweet_header (OutputSink *sink, long tweet_counter)
+{
+  sink_write_str (sink, TWEET_PREFIX);
+  sink_write_long (sink, tweet_counter);
+  sink_write_str (sink, TWEET_SEPARATOR);
+}
+
+/**
+ * A run of consecutive tweets for one generation thread.
+ */
+typedef struct GenerationTask
+{
+    const MarkovGraph *graph;
+    unsigned long seed;
+    long first_tweet; // number of the first tweet of the run
+    long num_tweets;
+    OutputSink *sink; // memory sink the tweets are written to
+} GenerationTask;
+
+static void *generate_task (void *arg)
 /**
- * Process the given word and add it to the database.
- * @param word - the word to process and add to the database
- * @param markov_chain - the markov_chain to add the word to
- * @param last_word - the last word that was processed
- * @return the markov_node that was created or found in the database
+ * Generate the tweets of a GenerationTask, each from its own random stream.
+ * @param arg pointer to the GenerationTask
+ * @return NULL
  */
 {
-  word[strcspn (word, END_LINE)] = 0;
-  unsigned int len_word = strlen (word);
-  char *tweet_copy = malloc (len_word + 1);
-  strcpy (tweet_copy, word);
-  Node *node = get_node_from_database (markov_chain, tweet_copy);
+  GenerationTask *task = (GenerationTask *) arg;
+  for (long i = 0; i < task->num_tweets; i++)
+  {
+    long tweet_counter = task->first_tweet + i;
+    RandomStream stream;
+    seed_random_stream (&stream, task->seed, (unsigned long) tweet_counter);
+    write_tweet_header (task->sink, tweet_counter);
+    graph_write_random_sequence (task->graph, NO_NODE, MAX_WORDS_IN_TWEET,
+                                 &stream, task->sink);
+  }
+  return NULL;
+}
 
-  if (node == NULL) // if markov_node not in markov_chain
+static bool generate_parallel (const MarkovGraph *graph, unsigned long seed,
+                               long first_tweet, long max_tweets,
+                               int num_threads, OutputSink *out)
+/**
+ * Generate max_tweets tweets, numbered from first_tweet, with num_threads
+ * threads. Tweet i is drawn from
+ * the random stream (seed, i), so the output is the same for any number of
+ * threads. The threads generate runs of TWEETS_PER_TASK tweets into their
+ * own memory sinks, which are written to out in order after every round.
+ * @return true on success, false in case of allocation error
+ */
+{
+  num_threads = num_threads > 0 ? num_threads : 1;
+  GenerationTask *tasks = calloc (num_threads, sizeof (GenerationTask));
+  pthread_t *threads = malloc (num_threads * sizeof (pthread_t));
+  bool *started = calloc (num_threads, sizeof (bool));
+  bool success = tasks && threads && started;
+  for (int i = 0; i < num_threads && success; i++)
+  {
+    tasks[i] = (GenerationTask) {graph, seed, 0, 0,
+                                 new_output_sink (NO_FD, 0)};
+    success = tasks[i].sink != NULL;
+  }
+  for (long done = 0; done < max_tweets && success;
+       done += (long) num_threads * TWEETS_PER_TASK)
   {
-    node = add_to_database (markov_chain, tweet_copy);
-    if (markov_chain->database->size == 1)
+    for (int i = 0; i < num_threads; i++)
     {
-      *last_word = node->data;
-      free (tweet_copy); // Freeing memory before returning
-      return node->data;
+      long task_done = done + (long) i * TWEETS_PER_TASK;
+      long remaining = max_tweets - task_done;
+      tasks[i].first_tweet = first_tweet + task_done;
+      tasks[i].num_tweets = remaining < 0 ? 0 : remaining < TWEETS_PER_TASK
+                                                ? remaining : TWEETS_PER_TASK;
+      started[i] = i > 0 && tasks[i].num_tweets > 0 && pthread_create
+          (&threads[i], NULL, generate_task, &tasks[i]) == 0;
     }
+    for (int i = 0; i < num_threads; i++)
+    {
+      if (started[i])
+      {
+        pthread_join (threads[i], NULL);
+      }
+      else
+      {
+        generate_task (&tasks[i]); // the main thread's run, or no thread
+      }
+      success = success && !tasks[i].sink->failed
+                && sink_write (out, tasks[i].sink->buffer, tasks[i].sink->len);
+      sink_reset (tasks[i].sink);
+    }
+  }
+  for (int i = 0; tasks && i < num_threads; i++)
+  {
+    free_output_sink (tasks[i].sink);
+  }
+  free (tasks);
+  free (threads);
+  free (started);
+  return success;
+}
+
+static int generate_from_graph (MarkovGraph *graph, unsigned long seed,
+                                long max_tweets, const Options *options)
+/**
+ * Generate max_tweets tweets from the graph: serially with rand(), or from
+ * the per-tweet random streams with options->gen_threads threads (see
+ * generate_parallel).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  if (max_tweets > 0 && graph->num_start_nodes == 0)
+  {
+    printf (NO_START_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  graph->sink = open_stdout_sink ();
+  if (graph->sink == NULL)
+  {
+    return EXIT_FAILURE;
+  }
+  bool generated = true;
+  if (options->gen_threads > 0)
+  {
+    generated = generate_parallel (graph, seed, options->first_tweet,
+                                   max_tweets, options->gen_threads,
+                                   graph->sink);
   }
-  if (!is_last_str ((*last_word)->data)) // word doesn't end with "."
+  for (long tweet_counter = 1;
+       options->gen_threads == 0 && tweet_counter <= max_tweets;
+       tweet_counter++)
   {
-    add_node_to_counter_list (*last_word, node->data, markov_chain);
+    write_tweet_header (graph->sink, tweet_counter);
+    graph_generate_random_sequence (graph, NO_NODE, MAX_WORDS_IN_TWEET);
   }
-  free (tweet_copy);
-  return node->data;
+  bool written = free_output_sink (graph->sink);
+  graph->sink = NULL;
+  if (!generated)
+  {
+    printf (ALLOCATION_ERR_MSG);
+  }
+  return generated && written ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-static void
-process_tweet (char *tweet, int *words_to_read,
-               struct MarkovChain *markov_chain, MarkovNode **last_word)
+static int quantize (MarkovGraph *graph, const Options *options)
 /**
- * The function reads 'words_to_read' words from the tweet and adds them to
- * the database and updates the last word that was processed.
- * @param tweet - the tweet to process and add to the database
- * @param words_to_read - the number of words to read from the tweet
- * @param markov_chain - the markov_chain to add the tweet to
- * @param last_word - the last word that was processed
+ * Quantize the graph's weights if the options ask to, and print the memory
+ * saved and the largest deviation to stderr (so it doesn't mix with the
+ * tweets).
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of allocation error
  */
 {
-  char *word = strtok (tweet, WHITE_SPACE);
-  while (word && *words_to_read)
+  if (options->quantize_bits == EXACT_WEIGHTS)
+  {
+    return EXIT_SUCCESS;
+  }
+  size_t bytes = markov_graph_memory (graph);
+  double max_deviation;
+  if (!quantize_markov_graph (graph, options->quantize_bits,
+                              options->renormalize, &max_deviation))
   {
-    *last_word = process_word (word, markov_chain, last_word);
-    word = strtok (NULL, WHITE_SPACE);
-    (*words_to_read)--;
+    printf (ALLOCATION_ERR_MSG);
+    return EXIT_FAILURE;
   }
+  fprintf (stderr, QUANTIZE_MSG, options->quantize_bits, bytes,
+           markov_graph_memory (graph), max_deviation);
+  return EXIT_SUCCESS;
 }
 
-static int
-fill_database (FILE *fp, int words_to_read, struct MarkovChain *markov_chain)
+static int generate_from_file (const char *path, unsigned long seed,
+                               long max_tweets, const Options *options)
 /**
- * Fill the markov_chain's database with the given words from the given file.
- * @param fp pointer to the file
- * @param words_to_read number of words to read from the file. If
- * words_to_read is -1, the function will read the entire file.
- * @param markov_chain pointer to the markov_chain
+ * Map the graph file and generate max_tweets tweets from it, walking it in
+ * place. Mapping is timed as the ingest phase and quantizing as the build.
  * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
  */
 {
-  char tweet[TWEET_MAX_LEN];
-  MarkovNode **last_word = malloc (sizeof (MarkovNode *));
+  STATS_START (ingest);
+  MarkovGraph *graph = map_string_markov_graph (path);
+  STATS_STOP (PHASE_INGEST, ingest);
+  if (graph == NULL)
+  {
+    printf (LOAD_ERR_MSG);
+    return EXIT_FAILURE;
+  }
+  STATS_START (build);
+  int result = quantize (graph, options);
+  STATS_STOP (PHASE_BUILD, build);
+  if (result == EXIT_SUCCESS)
+  {
+    STATS_START (generate);
+    result = generate_from_graph (graph, seed, max_tweets, options);
+    STATS_STOP (PHASE_GENERATE, generate);
+  }
+  STATS_START (teardown);
+  free_markov_graph (&graph);
+  STATS_STOP (PHASE_FREE, teardown);
+  return result;
+}
 
-  while (fgets (tweet, TWEET_MAX_LEN, fp) && words_to_read != 0)
+static int generate_from_chain (MarkovChain *markov_chain, unsigned long seed,
+                                long max_tweets, const Options *options)
+/**
+ * Generate max_tweets tweets from the chain: serially with rand(), or from
+ * the per-tweet random streams, serially or (with more than one thread) from
+ * the chain's compiled graph, which threads can walk at once. Both draw the
+ * same tweets from the streams. Quantized weights are only in the graph.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+{
+  if (options->gen_threads > 1 || options->quantize_bits != EXACT_WEIGHTS)
+  {
+    STATS_START (build);
+    MarkovGraph *graph = compile_markov_chain (markov_chain);
+    if (graph == NULL)
+    {
+      printf (ALLOCATION_ERR_MSG);
+    }
+    int result = graph ? quantize (graph, options) : EXIT_FAILURE;
+    STATS_STOP (PHASE_BUILD, build);
+    if (result == EXIT_SUCCESS)
+    {
+      STATS_START (generate);
+      result = generate_from_graph (graph, seed, max_tweets, options);
+      STATS_STOP (PHASE_GENERATE, generate);
+    }
+    STATS_START (teardown);
+    free_markov_graph (&graph);
+    STATS_STOP (PHASE_FREE, teardown);
+    return result;
+  }
+  if (max_tweets > 0 && markov_chain->num_start_nodes == 0)
   {
-    process_tweet (tweet, &words_to_read, markov_chain, last_word);
+    printf (NO_START_ERR_MSG);
+    return EXIT_FAILURE;
   }
+  markov_chain->sink = open_stdout_sink ();
+  if (markov_chain->sink == NULL)
+  {
+    return EXIT_FAILURE;
+  }
+  STATS_START (generate);
+  for (long i = 0; i < max_tweets; i++)
+  {
+    long tweet_counter = options->first_tweet + i;
+    RandomStream stream;
+    seed_random_stream (&stream, seed, (unsigned long) tweet_counter);
+    write_tweet_header (markov_chain->sink, tweet_counter);
+    generate_string_sequence (markov_chain, NULL, MAX_WORDS_IN_TWEET,
+                              options->gen_threads ? &stream : NULL);
+  }
+  bool written = free_output_sink (markov_chain->sink);
+  STATS_STOP (PHASE_GENERATE, generate);
+  markov_chain->sink = NULL;
+  return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-  free (last_word);
-  fclose (fp);
-  return EXIT_SUCCESS;
+static void print_chain_size (int order, const MarkovChain *vocabulary,
+                              size_t bytes)
+/**
+ * Print the size of the chain last counted by markov_stats_count to stderr:
+ * states, edges, words and bytes per state, so the cost of the order shows.
+ * @param order the order of the chain
+ * @param vocabulary the chain holding the words
+ * @param bytes the bytes the chain takes, words included
+ */
+{
+  int states = markov_stats.vocabulary;
+  fprintf (stderr, ORDER_MSG, order, states, markov_stats.edges,
+           vocabulary->database->size, bytes,
+           states ? (double) bytes / states : 0.0);
 }
 
-static int check_valid_args (int args)
+static int generate_from_ngram_chain (int args, char **argv,
+                                     unsigned long seed, long max_tweets,
+                                     const Options *options)
 /**
- * Check if the number of arguments is valid.
- * @param args the number of arguments
- * @return EXIT_SUCCESS if the number of arguments is valid, EXIT_FAILURE
- * otherwise
+ * Train a chain of order options->order on the text corpus and generate
+ * max_tweets tweets from it, serially: with rand(), or from the per-tweet
+ * random streams if options->gen_threads is set.
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
  */
 {
-  if (args < MIN_ARGS_NUM || args > MAX_ARGS_NUM)
+  NGramChain *ngram_chain = new_ngram_chain (options->order);
+  if (ngram_chain == NULL)
   {
-    printf (ARG_ERR_MSG);
+    printf (ALLOCATION_ERR_MSG);
     return EXIT_FAILURE;
   }
-  return EXIT_SUCCESS;
+  long int words_to_read = -1;
+  if (args == MAX_ARGS_NUM)
+  {
+    words_to_read = strtol (argv[WORDS_TO_READ_IND], NULL, DECIMAL);
+  }
+  MarkovChain *markov_chain = ngram_chain->markov_chain;
+  STATS_START (ingest);
+  int result = fill_ngram_chain (argv[TEXT_CORPUS_IND], words_to_read,
+                                 ngram_chain);
+  STATS_STOP (PHASE_INGEST, ingest);
+  if (result == EXIT_FAILURE)
+  {
+    // nothing read: the corpus is not a regular file (e.g. a pipe)
+    printf (ngram_chain->vocabulary->database->size == 0
+            ? FILE_ERR_MSG : ALLOCATION_ERR_MSG);
+  }
+  else if (max_tweets > 0 && markov_chain->num_start_nodes == 0)
+  {
+    printf (NO_START_ERR_MSG);
+    result = EXIT_FAILURE;
+  }
+  else if ((markov_chain->sink = open_stdout_sink ()) == NULL)
+  {
+    result = EXIT_FAILURE;
+  }
+  STATS_START (generate);
+  for (long i = 0; result == EXIT_SUCCESS && i < max_tweets; i++)
+  {
+    long tweet_counter = options->first_tweet + i;
+    RandomStream stream;
+    seed_random_stream (&stream, seed, (unsigned long) tweet_counter);
+    write_tweet_header (markov_chain->sink, tweet_counter);
+    generate_ngram_sequence (ngram_chain, MAX_WORDS_IN_TWEET,
+                             options->gen_threads ? &stream : NULL);
+  }
+  if (markov_chain->sink != NULL && !free_output_sink (markov_chain->sink))
+  {
+    result = EXIT_FAILURE;
+  }
+  markov_chain->sink = NULL;
+  STATS_STOP (PHASE_GENERATE, generate);
+  if (options->stats)
+  {
+    markov_stats_count (markov_chain);
+    print_chain_size (options->order, ngram_chain->vocabulary,
+                      ngram_chain_memory (ngram_chain));
+  }
+  STATS_START (teardown);
+  free_ngram_chain (&ngram_chain);
+  STATS_STOP (PHASE_FREE, teardown);
+  return result;
 }
 
 static int check_file (char *const *argv)
@@ -196,76 +718,75 @@ static int check_file (char *const *argv)
   return EXIT_SUCCESS;
 }
 
-static MarkovChain *initiate_markov_chain ()
-/**
- * Allocate memory for a new markov_chain.
- * @return a pointer to the new markov_chain
- */
-{
-  MarkovChain *markov_chain = malloc (sizeof (MarkovChain));
-  if (markov_chain == NULL)
-  {
-    printf (ALLOCATION_ERR_MSG);
-    return NULL;
-  }
-  return markov_chain;
-}
-
-static MarkovChain *initiate_linked_list (MarkovChain **markov_chain)
+static int report_stats (const Options *options, int result)
 /**
- * Allocate memory for a new linked_list and initiate the markov_chain.
- * @param markov_chain a pointer to the markov_chain
- * @return a pointer to the new markov_chain
+ * Print the stats (see print_markov_stats) to stderr if asked to, so they
+ * don't mix with the tweets.
+ * @return result
  */
 {
-  LinkedList *list = malloc (sizeof (LinkedList));
-  if (list == NULL)
+  if (options->stats)
   {
-    printf (ALLOCATION_ERROR_MASSAGE);
-    return NULL;
+    print_markov_stats (stderr);
   }
-  *list = (LinkedList) {NULL, NULL, 0};
-  (**markov_chain) = (MarkovChain)
-      {list, print_str, comp_str,
-       free, copy_str, is_last_str};
-  return *markov_chain;
+  return result;
 }
 
 int main (int args, char **argv)
 {
-  if (check_valid_args (args))
+  Options options;
+  if (parse_options (&args, argv, &options)
+      || check_valid_args (args, &options))
   {
     return EXIT_FAILURE;
   }
-  if (check_file (argv))
+  if (!options.load_path && !options.map_path && check_file (argv))
   {
     return EXIT_FAILURE;
   }
   long int seed = strtol (argv[SEED_IND], NULL, DECIMAL);
-  long int words_to_read = -1;
-  if (args == MAX_ARGS_NUM)
+  srand (seed);
+  long int max_tweets = strtol (argv[TWEETS_IND], NULL, DECIMAL);
+  if (options.map_path)
   {
-    words_to_read = strtol (argv[WORDS_TO_READ_IND], NULL, DECIMAL);
+    return report_stats (&options, generate_from_file
+        (options.map_path, (unsigned long) seed, max_tweets, &options));
   }
-  srand (seed);
-  MarkovChain *markov_chain = initiate_markov_chain ();
-  if (!markov_chain)
-  { return EXIT_FAILURE; }
-  initiate_linked_list (&markov_chain);
-  if (!markov_chain->database)
-  { return EXIT_FAILURE; }
-  FILE *input = NULL;
-  input = fopen (argv[TEXT_CORPUS_IND], "r");
-  fill_database (input, words_to_read, markov_chain);
-  long int max_tweets = strtol
-      (argv[TWEETS_IND], NULL, DECIMAL);
-  int tweet_counter = 1;
-  while (tweet_counter <= max_tweets)
+  if (options.order != DEFAULT_ORDER)
+  {
+    return report_stats (&options, generate_from_ngram_chain
+        (args, argv, (unsigned long) seed, max_tweets, &options));
+  }
+  MarkovChain *markov_chain = new_string_markov_chain ();
+  if (!markov_chain || !use_node_arena (markov_chain))
+  {
+    printf (ALLOCATION_ERR_MSG);
+    if (markov_chain)
+    {
+      free_markov_chain (&markov_chain);
+    }
+    return EXIT_FAILURE;
+  }
+  int result = EXIT_FAILURE;
+  STATS_START (ingest);
+  bool built = build_chain (args, argv, &options, markov_chain)
+               == EXIT_SUCCESS;
+  STATS_STOP (PHASE_INGEST, ingest);
+  if (built && (!options.save_graph_path
+                || save_graph (markov_chain, options.save_graph_path)
+                   == EXIT_SUCCESS))
   {
-    printf ("Tweet %d:", tweet_counter);
-    generate_random_sequence (markov_chain, NULL, MAX_WORDS_IN_TWEET);
-    tweet_counter++;
+    result = generate_from_chain (markov_chain, (unsigned long) seed,
+                                  max_tweets, &options);
   }
+  if (options.stats)
+  {
+    markov_stats_count (markov_chain);
+    print_chain_size (DEFAULT_ORDER, markov_chain,
+                      markov_chain_memory (markov_chain));
+  }
+  STATS_START (teardown);
   free_markov_chain (&markov_chain);
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+  STATS_STOP (PHASE_FREE, teardown);
+  return report_stats (&options, result);
+}